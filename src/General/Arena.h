@@ -0,0 +1,152 @@
+/*
+ * Arena.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ *
+ *  Bump-pointer allocator for short-lived objects, e.g. those created while processing one command
+ */
+
+#ifndef SRC_GENERAL_ARENA_H_
+#define SRC_GENERAL_ARENA_H_
+
+#include "../ecv_duet3d.h"
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// An Arena allocates from a block of memory supplied by the caller by advancing a pointer, so allocation is very fast and individual objects are never freed.
+// Instead, the caller takes a Mark before a piece of work and rolls back to it afterwards, which frees everything allocated since in one step.
+// Rolling back doesn't call destructors, so only objects that don't need destroying may be created in an arena.
+// An arena must only be used by one task at a time.
+class Arena
+{
+public:
+	typedef size_t Mark;
+
+	Arena(void *_ecv_array mem, size_t size) noexcept : base(static_cast<uint8_t *_ecv_array>(mem)), capacity(size), used(0), peakUsed(0) { }
+
+	// Allocate memory with the specified alignment, which must be a power of 2. Return nullptr if there is not enough space.
+	void *_ecv_null Allocate(size_t size, size_t alignment = alignof(std::max_align_t)) noexcept;
+
+	// Allocate memory for 'count' objects of type T without constructing them
+	template<class T> T *_ecv_array _ecv_null AllocateArray(size_t count) noexcept
+	{
+		return (count > capacity/sizeof(T)) ? nullptr : static_cast<T *_ecv_array _ecv_null>(Allocate(count * sizeof(T), alignof(T)));
+	}
+
+	// Allocate and construct an object, returning nullptr if there is not enough space
+	template<class T, class... Args> T *_ecv_null Create(Args&&... args) noexcept
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "Objects created in an arena are never destroyed");
+		void *_ecv_null const mem = Allocate(sizeof(T), alignof(T));
+		return (mem == nullptr) ? nullptr : new (mem) T(std::forward<Args>(args)...);
+	}
+
+	// Record the current allocation point
+	Mark GetMark() const noexcept { return used; }
+
+	// Free everything allocated since the mark was taken
+	void Rollback(Mark m) noexcept { if (m < used) { used = m; } }
+
+	// Free everything
+	void Reset() noexcept { used = 0; }
+
+	// Free a block if it was the most recent allocation, else do nothing. This helps containers that grow their storage.
+	void FreeIfLatest(const void *p, size_t size) noexcept
+	{
+		if (static_cast<const uint8_t *>(p) + size == base + used)
+		{
+			used = (size_t)(static_cast<const uint8_t *>(p) - base);
+		}
+	}
+
+	size_t GetCapacity() const noexcept { return capacity; }
+	size_t GetUsed() const noexcept { return used; }
+	size_t GetPeakUsed() const noexcept { return peakUsed; }
+	size_t SpaceLeft() const noexcept { return capacity - used; }
+
+	// Return true if the memory was allocated from this arena
+	bool Owns(const void *p) const noexcept { return p >= base && p < base + capacity; }
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+private:
+	uint8_t *_ecv_array base;
+	size_t capacity;
+	size_t used;
+	size_t peakUsed;
+};
+
+inline void *_ecv_null Arena::Allocate(size_t size, size_t alignment) noexcept
+{
+	// Align the address rather than the offset, because the base of the memory may not be aligned
+	const uintptr_t start = ((uintptr_t)(base + used) + (alignment - 1)) & ~(uintptr_t)(alignment - 1);
+	const size_t offset = (size_t)(start - (uintptr_t)base);
+	if (offset > capacity || size > capacity - offset)
+	{
+		return nullptr;
+	}
+	used = offset + size;
+	if (used > peakUsed)
+	{
+		peakUsed = used;
+	}
+	return base + offset;
+}
+
+// Class to roll back an arena automatically when it goes out of scope
+class ArenaScope
+{
+public:
+	explicit ArenaScope(Arena& a) noexcept : arena(a), mark(a.GetMark()) { }
+	~ArenaScope() noexcept { arena.Rollback(mark); }
+
+	ArenaScope(const ArenaScope&) = delete;
+	ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+	Arena& arena;
+	Arena::Mark mark;
+};
+
+// Function called by ArenaAllocator when the arena is full. The client must provide it if ArenaAllocator is used, and it must not return.
+[[noreturn]] void ArenaAllocatorExhausted(const Arena& arena, size_t size) noexcept;
+
+// Allocator with the allocate/deallocate interface that standard library containers use, for containers whose storage should come from an arena.
+// It doesn't meet all the requirements of a standard allocator: deallocation does nothing unless the memory is the most recent allocation.
+// Containers don't check whether allocation succeeded, so allocate never returns nullptr. If the arena is full it calls ArenaAllocatorExhausted instead.
+// Code that can recover from running out of space should call Arena::AllocateArray directly.
+template<class T> class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	explicit ArenaAllocator(Arena& a) noexcept : arena(&a) { }
+	template<class U> ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.GetArena()) { }
+
+	T *_ecv_array allocate(size_t n) noexcept
+	{
+		T *_ecv_array _ecv_null const p = arena->AllocateArray<T>(n);
+		if (p == nullptr)
+		{
+			ArenaAllocatorExhausted(*arena, n * sizeof(T));
+		}
+		return p;
+	}
+
+	void deallocate(T *_ecv_array p, size_t n) noexcept { arena->FreeIfLatest(p, n * sizeof(T)); }
+
+	Arena *GetArena() const noexcept { return arena; }
+
+	template<class U> bool operator==(const ArenaAllocator<U>& other) const noexcept { return arena == other.GetArena(); }
+	template<class U> bool operator!=(const ArenaAllocator<U>& other) const noexcept { return arena != other.GetArena(); }
+
+private:
+	Arena *arena;
+};
+
+#endif /* SRC_GENERAL_ARENA_H_ */
@@ -409,6 +409,10 @@ public:
 
 	unsigned int FindLowestSetBit() const noexcept;
 
+	// Iterate over the set bits while the passed function returns true. Return true if we reached the end, false if we terminated because the passed function returned false.
+	// The function may clear the bit it is passed.
+	bool IterateWhile(function_ref_noexcept<bool(unsigned int) noexcept> func) const noexcept;
+
 	static constexpr unsigned int NumBits() noexcept { return N; }
 
 private:
@@ -437,4 +441,22 @@ template<unsigned int N> unsigned int LargeBitmap<N>::FindLowestSetBit() const n
 	return N;
 }
 
+template<unsigned int N> bool LargeBitmap<N>::IterateWhile(function_ref_noexcept<bool(unsigned int) noexcept> func) const noexcept
+{
+	for (unsigned int i = 0; i < numDwords; ++i)
+	{
+		uint32_t copyBits = data[i];
+		while (copyBits != 0)
+		{
+			const unsigned int index = LowestSetBit(copyBits);
+			if (!func((i << 5) + index))
+			{
+				return false;
+			}
+			copyBits &= ~((uint32_t)1 << index);
+		}
+	}
+	return true;
+}
+
 #endif /* SRC_GENERAL_BITMAP_H_ */
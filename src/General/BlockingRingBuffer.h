@@ -0,0 +1,269 @@
+/*
+ * BlockingRingBuffer.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ *
+ *  Ring buffer that lets the getter wait for data and the putter wait for space, instead of polling
+ */
+
+#ifndef SRC_GENERAL_BLOCKINGRINGBUFFER_H_
+#define SRC_GENERAL_BLOCKINGRINGBUFFER_H_
+
+#include "RingBuffer.h"
+
+#ifdef RTOS
+# include "../RTOSIface/RTOSIface.h"
+
+// Class to wake up and wait for tasks using FreeRTOS task notifications. Other implementations with the same members can be used instead, e.g. when testing on a host.
+// Waiter must be a pointer type. Wake may be called with fromIsr true only from an ISR, and with fromIsr false only from a task.
+// The client chooses the notification index, normally one of its own at or above NotifyIndices::NextAvailableAfterRTOS, and must not use it for anything else in the waiting tasks.
+template<uint32_t NotifyIndex> class RingBufferTaskNotifier
+{
+public:
+	typedef TaskBase *_ecv_from Waiter;
+
+	static Waiter CurrentWaiter() noexcept { return TaskBase::GetCallerTaskHandle(); }
+	static uint32_t GetTicks() noexcept { return xTaskGetTickCount(); }
+	static bool Wait(uint32_t timeout) noexcept { return TaskBase::TakeIndexed(NotifyIndex, timeout); }
+	static void Wake(Waiter w, bool fromIsr) noexcept
+	{
+		if (fromIsr)
+		{
+			TaskBase::GiveFromISR(w, NotifyIndex);
+		}
+		else
+		{
+			w->Give(NotifyIndex);
+		}
+	}
+
+	static constexpr uint32_t TimeoutUnlimited = TaskBase::TimeoutUnlimited;
+};
+
+#endif
+
+// The usual RingBuffer rules apply: max one putter and one getter, which may be tasks or ISRs. Only tasks may call the functions that wait.
+// A waiting getter is woken once enough items are present to satisfy it, and a waiting putter is woken once the number of items present has fallen to the low water mark
+// or when the getter starts to wait for more items.
+// So with suitable thresholds a getter that processes data in batches is woken once per batch rather than once per item.
+// Functions that may wake the other side take a 'fromIsr' parameter, which must be true when they are called from an ISR.
+// Under RTOS the Notifier is normally RingBufferTaskNotifier<index>, e.g. BlockingRingBuffer<char, RingBufferTaskNotifier<NotifyIndices::UsbBuffer>>.
+template<class T, class Notifier> class BlockingRingBuffer
+{
+public:
+	typedef typename Notifier::Waiter Waiter;
+
+	BlockingRingBuffer() noexcept : lowWater(0), highWater(1), getterWants(1), waitingGetter(nullptr), waitingPutter(nullptr) { }
+
+	// Initialise and allocate the buffer. numSlots must be a power of 2.
+	void Init(size_t numSlots) noexcept { buffer.Init(numSlots); }
+
+	// Set the thresholds. A waiting putter is woken when the number of items present falls to 'low'. WaitForItems without a count waits for 'high' items to be present.
+	void SetWakeThresholds(size_t low, size_t high) noexcept;
+
+	// Putter functions that don't wait
+	bool PutItem(T val, bool fromIsr = false) noexcept;
+	size_t PutBlock(const T* _ecv_array buf, size_t buflen, bool fromIsr = false) noexcept;
+
+	// Store a block, waiting for space if necessary, returning the number of items stored. Fewer than buflen items are stored only if we time out.
+	size_t PutBlockWait(const T* _ecv_array buf, size_t buflen, uint32_t timeout = Notifier::TimeoutUnlimited) noexcept;
+
+	// Getter functions that don't wait
+	bool GetItem(T& val, bool fromIsr = false) noexcept;
+	size_t GetBlock(T* _ecv_array buf, size_t buflen, bool fromIsr = false) noexcept;
+
+	// Wait until at least minItems items are present or we time out, returning true if they are present
+	bool WaitForItems(size_t minItems, uint32_t timeout = Notifier::TimeoutUnlimited) noexcept;
+
+	// Wait until the number of items given by the high water mark are present or we time out, returning true if they are present
+	bool WaitForItems(uint32_t timeout = Notifier::TimeoutUnlimited) noexcept { return WaitForItems(highWater, timeout); }
+
+	// Wait until at least minItems are present or we time out, then fetch up to buflen items, returning the number fetched.
+	// If we time out then whatever items are present are fetched, so the return value may be less than minItems.
+	size_t GetBlockWait(T* _ecv_array buf, size_t buflen, size_t minItems, uint32_t timeout = Notifier::TimeoutUnlimited) noexcept;
+
+	size_t SpaceLeft() const noexcept { return buffer.SpaceLeft(); }
+	size_t ItemsPresent() const noexcept { return buffer.ItemsPresent(); }
+	bool IsEmpty() const noexcept { return buffer.IsEmpty(); }
+	size_t GetCapacity() const noexcept { return buffer.GetCapacity(); }
+
+private:
+	// Register the caller as the waiter and wait until isReady returns true or we time out, returning the final value of isReady.
+	// afterRegistering is called each time we have registered as the waiter, before checking isReady again.
+	template<class F, class G> bool WaitUntil(std::atomic<Waiter>& waiter, uint32_t timeout, F isReady, G afterRegistering) noexcept;
+
+	// Called after storing or fetching items to wake the other side if it is waiting and its condition is now satisfied
+	void WakeGetterIfReady(bool fromIsr) noexcept;
+	void WakePutterIfReady(bool fromIsr) noexcept;
+
+	// Wake up the putter if it is waiting, whatever the low water mark
+	void WakePutter() noexcept;
+
+	RingBuffer<T> buffer;
+	size_t lowWater;
+	size_t highWater;
+	volatile size_t getterWants;					// the number of items the waiting getter wants
+	std::atomic<Waiter> waitingGetter;
+	std::atomic<Waiter> waitingPutter;
+};
+
+template<class T, class Notifier> void BlockingRingBuffer<T, Notifier>::SetWakeThresholds(size_t low, size_t high) noexcept
+{
+	lowWater = low;
+	highWater = (high == 0) ? 1 : high;
+}
+
+template<class T, class Notifier> inline void BlockingRingBuffer<T, Notifier>::WakeGetterIfReady(bool fromIsr) noexcept
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);					// don't let the load of the waiter move before our store of the ring buffer index
+	if (waitingGetter.load(std::memory_order_acquire) != nullptr && buffer.ItemsPresent() >= getterWants)
+	{
+		// Only wake the getter if we are the one that removes it, in case the getter itself or another call has already done so
+		const Waiter w = waitingGetter.exchange(nullptr, std::memory_order_acq_rel);
+		if (w != nullptr)
+		{
+			Notifier::Wake(w, fromIsr);
+		}
+	}
+}
+
+template<class T, class Notifier> inline void BlockingRingBuffer<T, Notifier>::WakePutterIfReady(bool fromIsr) noexcept
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);					// don't let the load of the waiter move before our store of the ring buffer index
+	if (waitingPutter.load(std::memory_order_acquire) != nullptr && buffer.ItemsPresent() <= lowWater)
+	{
+		const Waiter w = waitingPutter.exchange(nullptr, std::memory_order_acq_rel);
+		if (w != nullptr)
+		{
+			Notifier::Wake(w, fromIsr);
+		}
+	}
+}
+
+template<class T, class Notifier> void BlockingRingBuffer<T, Notifier>::WakePutter() noexcept
+{
+	const Waiter w = waitingPutter.exchange(nullptr);
+	if (w != nullptr)
+	{
+		Notifier::Wake(w, false);
+	}
+}
+
+template<class T, class Notifier> template<class F, class G> bool BlockingRingBuffer<T, Notifier>::WaitUntil(std::atomic<Waiter>& waiter, uint32_t timeout, F isReady, G afterRegistering) noexcept
+{
+	const uint32_t startTicks = Notifier::GetTicks();
+	for (;;)
+	{
+		if (isReady())
+		{
+			return true;
+		}
+
+		// Register as the waiter, then check again in case the other side stored or fetched items before it could see that we are waiting.
+		// The fences here and in WakeGetterIfReady/WakePutterIfReady stop each side's load moving before its store, so that at least one side sees the other.
+		waiter.store(Notifier::CurrentWaiter());
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		afterRegistering();
+		if (isReady())
+		{
+			waiter.store(nullptr, std::memory_order_release);
+			return true;
+		}
+
+		uint32_t remaining = Notifier::TimeoutUnlimited;
+		if (timeout != Notifier::TimeoutUnlimited)
+		{
+			const uint32_t elapsed = Notifier::GetTicks() - startTicks;
+			if (elapsed >= timeout)
+			{
+				waiter.store(nullptr, std::memory_order_release);
+				return isReady();
+			}
+			remaining = timeout - elapsed;
+		}
+
+		// The wakeup may be stale if the other side woke us after we had stopped waiting last time, so always recheck the condition
+		(void)Notifier::Wait(remaining);
+		waiter.store(nullptr, std::memory_order_release);
+	}
+}
+
+template<class T, class Notifier> bool BlockingRingBuffer<T, Notifier>::PutItem(T val, bool fromIsr) noexcept
+{
+	if (buffer.PutItem(val))
+	{
+		WakeGetterIfReady(fromIsr);
+		return true;
+	}
+	return false;
+}
+
+template<class T, class Notifier> size_t BlockingRingBuffer<T, Notifier>::PutBlock(const T* _ecv_array buf, size_t buflen, bool fromIsr) noexcept
+{
+	const size_t stored = buffer.PutBlock(buf, buflen);
+	if (stored != 0)
+	{
+		WakeGetterIfReady(fromIsr);
+	}
+	return stored;
+}
+
+template<class T, class Notifier> size_t BlockingRingBuffer<T, Notifier>::PutBlockWait(const T* _ecv_array buf, size_t buflen, uint32_t timeout) noexcept
+{
+	size_t stored = PutBlock(buf, buflen);
+	while (stored < buflen)
+	{
+		// Also continue if the getter is waiting for more items, otherwise neither side would make progress
+		if (!WaitUntil(waitingPutter, timeout,
+						[this]() noexcept -> bool { return buffer.ItemsPresent() <= lowWater || waitingGetter.load() != nullptr; },
+						[]() noexcept -> void { }))
+		{
+			break;
+		}
+		stored += PutBlock(buf + stored, buflen - stored);
+	}
+	return stored;
+}
+
+template<class T, class Notifier> bool BlockingRingBuffer<T, Notifier>::GetItem(T& val, bool fromIsr) noexcept
+{
+	if (buffer.GetItem(val))
+	{
+		WakePutterIfReady(fromIsr);
+		return true;
+	}
+	return false;
+}
+
+template<class T, class Notifier> size_t BlockingRingBuffer<T, Notifier>::GetBlock(T* _ecv_array buf, size_t buflen, bool fromIsr) noexcept
+{
+	const size_t fetched = buffer.GetBlock(buf, buflen);
+	if (fetched != 0)
+	{
+		WakePutterIfReady(fromIsr);
+	}
+	return fetched;
+}
+
+template<class T, class Notifier> bool BlockingRingBuffer<T, Notifier>::WaitForItems(size_t minItems, uint32_t timeout) noexcept
+{
+	if (minItems > buffer.GetCapacity())
+	{
+		minItems = buffer.GetCapacity();
+	}
+	getterWants = minItems;
+
+	// If the putter is waiting for the number of items present to fall to the low water mark, it may never get there while we wait for more items, so let it continue
+	return WaitUntil(waitingGetter, timeout,
+						[this, minItems]() noexcept -> bool { return buffer.ItemsPresent() >= minItems; },
+						[this]() noexcept -> void { WakePutter(); });
+}
+
+template<class T, class Notifier> size_t BlockingRingBuffer<T, Notifier>::GetBlockWait(T* _ecv_array buf, size_t buflen, size_t minItems, uint32_t timeout) noexcept
+{
+	(void)WaitForItems((minItems < buflen) ? minItems : buflen, timeout);
+	return GetBlock(buf, buflen);
+}
+
+#endif /* SRC_GENERAL_BLOCKINGRINGBUFFER_H_ */
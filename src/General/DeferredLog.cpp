@@ -0,0 +1,114 @@
+/*
+ * DeferredLog.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ */
+
+#include "DeferredLog.h"
+
+using namespace DeferredLogDetail;
+
+bool DeferredLogMessage::Decode(const uint8_t *_ecv_array record, size_t length) noexcept
+{
+	if (length < sizeof(RecordHeader))
+	{
+		return false;
+	}
+
+	RecordHeader header;
+	memcpy(&header, record, sizeof(header));
+	format = header.format;
+	timestamp = header.timestamp;
+	numArgs = 0;
+
+	const uint8_t *_ecv_array p = record + sizeof(header);
+	const uint8_t *_ecv_array const end = record + length;
+	for (uint32_t kinds = header.kinds; kinds != 0; kinds >>= 4)
+	{
+		if (numArgs == MaxArgs)
+		{
+			return false;
+		}
+		CapturedPrintArg& arg = args[numArgs++];
+		arg.i = 0;
+		const size_t spaceLeft = (size_t)(end - p);
+		size_t size;
+		switch ((ArgKind)(kinds & 0x0F))
+		{
+		case ArgKind::word:
+		case ArgKind::signedWord:
+		case ArgKind::floatValue:
+			{
+				size = sizeof(uint32_t);
+				if (spaceLeft < size)
+				{
+					return false;
+				}
+				uint32_t val;
+				memcpy(&val, p, sizeof(val));
+				if ((ArgKind)(kinds & 0x0F) == ArgKind::floatValue)
+				{
+					float f;
+					memcpy(&f, &val, sizeof(f));
+					arg.f = (double)f;
+				}
+				else
+				{
+					arg.i = ((ArgKind)(kinds & 0x0F) == ArgKind::signedWord) ? (long long)(int32_t)val : (long long)val;
+				}
+			}
+			break;
+
+		case ArgKind::longWord:
+		case ArgKind::doubleValue:
+			size = sizeof(uint64_t);
+			if (spaceLeft < size)
+			{
+				return false;
+			}
+			memcpy(&arg, p, size);
+			break;
+
+		case ArgKind::pointer:
+		case ArgKind::pinnedString:
+			size = RoundUp4(sizeof(const char *));
+			if (spaceLeft < size)
+			{
+				return false;
+			}
+			{
+				const char *_ecv_array null s;
+				memcpy(&s, p, sizeof(s));
+				if ((ArgKind)(kinds & 0x0F) == ArgKind::pinnedString)
+				{
+					arg.s = s;
+				}
+				else
+				{
+					arg.i = (long long)(uintptr_t)s;
+				}
+			}
+			break;
+
+		case ArgKind::copiedString:
+			{
+				const size_t len = Strnlen((const char *_ecv_array)p, spaceLeft);
+				if (len == spaceLeft)
+				{
+					return false;				// no terminator
+				}
+				arg.s = (const char *_ecv_array)p;
+				size = RoundUp4(len + 1);
+			}
+			break;
+
+		default:
+			return false;
+		}
+		p += size;
+	}
+	return true;
+}
+
+// End
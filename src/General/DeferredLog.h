@@ -0,0 +1,283 @@
+/*
+ * DeferredLog.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ *
+ *  Log messages that are stored in binary form by time-critical tasks and formatted later by a low-priority task
+ */
+
+#ifndef SRC_GENERAL_DEFERREDLOG_H_
+#define SRC_GENERAL_DEFERREDLOG_H_
+
+#include "../ecv_duet3d.h"
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <atomic>
+#include <type_traits>
+#include "MpscRingBuffer.h"
+#include "SafeVsnprintf.h"
+#include "Strnlen.h"
+
+// Wrapper for a string argument that will remain valid until the message has been printed, e.g. a string literal, so that only the pointer is stored
+struct PinnedString
+{
+	const char *_ecv_array null s;
+};
+
+inline PinnedString Pin(const char *_ecv_array null s) noexcept { return PinnedString{ s }; }
+
+namespace DeferredLogDetail
+{
+	// How each argument is stored in a record. The kinds of all the arguments are packed into a 32-bit word, 4 bits per argument, with the first argument in the lowest bits.
+	enum class ArgKind : uint8_t { none = 0, word, signedWord, longWord, floatValue, doubleValue, copiedString, pinnedString, pointer };
+
+	constexpr size_t MaxArgs = 8;
+	constexpr size_t MaxCopiedStringLength = 63;				// longer strings are truncated
+
+	// Fixed part of each record. It is followed by the arguments, each padded to a multiple of 4 bytes.
+	struct RecordHeader
+	{
+		const char *_ecv_array format;
+		uint32_t timestamp;
+		uint32_t kinds;
+	};
+
+	template<class T> constexpr ArgKind KindOf() noexcept
+	{
+		typedef typename std::decay<T>::type U;
+		if constexpr (std::is_same<U, PinnedString>::value)
+		{
+			return ArgKind::pinnedString;
+		}
+		else if constexpr (std::is_same<U, const char *>::value || std::is_same<U, char *>::value)
+		{
+			return ArgKind::copiedString;
+		}
+		else if constexpr (std::is_same<U, float>::value)
+		{
+			return ArgKind::floatValue;
+		}
+		else if constexpr (std::is_floating_point<U>::value)
+		{
+			return ArgKind::doubleValue;
+		}
+		else if constexpr (std::is_pointer<U>::value)
+		{
+			return ArgKind::pointer;
+		}
+		else
+		{
+			static_assert(std::is_integral<U>::value || std::is_enum<U>::value, "Unsupported argument type for DeferredLog");
+			return (sizeof(U) > sizeof(uint32_t)) ? ArgKind::longWord
+					: (std::is_signed<U>::value) ? ArgKind::signedWord
+						: ArgKind::word;
+		}
+	}
+
+	template<class... Args> constexpr uint32_t PackKinds() noexcept
+	{
+		const ArgKind kinds[] = { KindOf<Args>()..., ArgKind::none };
+		uint32_t packed = 0;
+		for (size_t i = 0; i < sizeof...(Args); ++i)
+		{
+			packed |= (uint32_t)kinds[i] << (4 * i);
+		}
+		return packed;
+	}
+
+	constexpr size_t RoundUp4(size_t n) noexcept { return (n + 3u) & ~(size_t)3u; }
+
+	// Return the number of characters of an argument that will be copied, or zero if it isn't a copied string.
+	// This is called only once per argument, because another task may change the string while we are storing it.
+	template<class T> inline size_t CopiedLength(const T& arg) noexcept
+	{
+		if constexpr (KindOf<T>() == ArgKind::copiedString)
+		{
+			return (arg == nullptr) ? 0 : Strnlen(arg, MaxCopiedStringLength);
+		}
+		else
+		{
+			(void)arg;
+			return 0;
+		}
+	}
+
+	// Return the most bytes that an argument of type T can need
+	template<class T> constexpr size_t MaxStoredSize() noexcept
+	{
+		typedef typename std::decay<T>::type U;
+		if constexpr (KindOf<T>() == ArgKind::copiedString)
+		{
+			return RoundUp4(MaxCopiedStringLength + 1);
+		}
+		else if constexpr (KindOf<T>() == ArgKind::pinnedString)
+		{
+			return RoundUp4(sizeof(const char *));
+		}
+		else if constexpr (KindOf<T>() == ArgKind::longWord)
+		{
+			return sizeof(uint64_t);
+		}
+		else
+		{
+			return RoundUp4(sizeof(U));
+		}
+	}
+
+	// Return the number of bytes needed to store an argument, given the value returned by CopiedLength
+	template<class T> inline size_t StoredSize(const T& arg, size_t len) noexcept
+	{
+		(void)arg;
+		if constexpr (KindOf<T>() == ArgKind::copiedString)
+		{
+			return RoundUp4(len + 1);
+		}
+		else
+		{
+			return MaxStoredSize<T>();
+		}
+	}
+
+	// Store an argument and return where to store the next one. 'len' is the value that CopiedLength returned for it.
+	template<class T> inline uint8_t *_ecv_array Store(uint8_t *_ecv_array p, const T& arg, size_t len) noexcept
+	{
+		typedef typename std::decay<T>::type U;
+		(void)len;
+		if constexpr (KindOf<T>() == ArgKind::copiedString)
+		{
+			// A null pointer is stored as an empty string, which prints differently from "<null>" but avoids an extra kind
+			if (len != 0)
+			{
+				memcpy(p, arg, len);
+			}
+			p[len] = 0;
+			return p + RoundUp4(len + 1);
+		}
+		else if constexpr (KindOf<T>() == ArgKind::pinnedString)
+		{
+			memcpy(p, &arg.s, sizeof(arg.s));
+			return p + RoundUp4(sizeof(arg.s));
+		}
+		else if constexpr (KindOf<T>() == ArgKind::longWord)
+		{
+			const uint64_t val = (uint64_t)arg;
+			memcpy(p, &val, sizeof(val));
+			return p + sizeof(val);
+		}
+		else if constexpr (KindOf<T>() == ArgKind::word || KindOf<T>() == ArgKind::signedWord)
+		{
+			const uint32_t val = (uint32_t)arg;
+			memcpy(p, &val, sizeof(val));
+			return p + sizeof(val);
+		}
+		else
+		{
+			memcpy(p, &arg, sizeof(U));
+			return p + RoundUp4(sizeof(U));
+		}
+	}
+}
+
+// A message taken from a DeferredLog, ready to be printed. Copied strings point into the log's storage, so print the message before calling Pop.
+struct DeferredLogMessage
+{
+	const char *_ecv_array format;
+	uint32_t timestamp;
+	size_t numArgs;
+	CapturedPrintArg args[DeferredLogDetail::MaxArgs];
+
+	// Decode a record, returning false if it is malformed
+	bool Decode(const uint8_t *_ecv_array record, size_t length) noexcept;
+
+	// Print the message in the same way as uprintf, returning the number of characters printed
+	int Print(PrintSink& sink) const noexcept { return PrintWithCapturedArgs(sink, format, args, numArgs); }
+};
+
+// Log of messages that is fast to write to. Log only copies the format pointer, a timestamp and the arguments into an MpscRingBuffer, which takes far less time than formatting the message.
+// A low-priority task calls Peek to get each message, prints it, then calls Pop.
+// Because formatting is deferred, the format must be a string that remains valid, normally a literal. String arguments are copied unless they are wrapped by Pin().
+// The types of the arguments are found at compile time and stored with the record. The arguments must match the format as for printf. 64-bit integers need the "ll" modifier, because without it only the low 32 bits are printed.
+// Each call of Log is checked at compile time to make sure that its record fits in the ring buffer, even if every copied string is of the maximum length.
+// Like MpscRingBuffer, Log may be called by several tasks and ISRs at once. If there is no room then the message is discarded and counted.
+// Example: log.Log("Move %u ended at %.3f, reason %s", moveNumber, position, Pin(reasonText));
+template<size_t NumSlots, size_t SlotSize = 16> class DeferredLog
+{
+public:
+	typedef uint32_t (*TimestampFunction)() noexcept;
+
+	explicit DeferredLog(TimestampFunction tf) noexcept : getTimestamp(tf), numDiscarded(0) { }
+
+	// Store a message, returning false if there was no room
+	template<class... Args> bool Log(const char *_ecv_array format, const Args&... args) noexcept;
+
+	// Consumer functions. Only one task may call these.
+	// Decode the oldest message, returning false if there are none
+	bool Peek(DeferredLogMessage& msg) noexcept;
+
+	// Remove the message returned by the last successful call to Peek
+	void Pop() noexcept { ring.Pop(); }
+
+	// Return the number of messages discarded because there was no room, and reset it
+	uint32_t GetAndClearNumDiscarded() noexcept { return numDiscarded.exchange(0, std::memory_order_relaxed); }
+
+private:
+	MpscRingBuffer<NumSlots, SlotSize> ring;
+	TimestampFunction getTimestamp;
+	std::atomic<uint32_t> numDiscarded;
+};
+
+template<size_t NumSlots, size_t SlotSize> template<class... Args> bool DeferredLog<NumSlots, SlotSize>::Log(const char *_ecv_array format, const Args&... args) noexcept
+{
+	using namespace DeferredLogDetail;
+	static_assert(sizeof...(Args) <= MaxArgs, "Too many arguments for DeferredLog");
+	static_assert((sizeof(RecordHeader) + ... + MaxStoredSize<Args>()) <= MpscRingBuffer<NumSlots, SlotSize>::MaxRecordLength(),
+					"DeferredLog is too small for these arguments, allowing for copied strings of the maximum length");
+
+	const size_t lengths[] = { CopiedLength(args)..., 0 };
+	size_t recordSize = sizeof(RecordHeader);
+	if constexpr (sizeof...(Args) != 0)
+	{
+		size_t i = 0;
+		((recordSize += StoredSize(args, lengths[i++])), ...);
+	}
+
+	const auto r = ring.Reserve(recordSize);
+	if (!r.IsValid())
+	{
+		numDiscarded.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	const RecordHeader header{ format, getTimestamp(), PackKinds<Args...>() };
+	memcpy(r.data, &header, sizeof(header));
+	if constexpr (sizeof...(Args) != 0)
+	{
+		uint8_t *_ecv_array p = r.data + sizeof(header);
+		size_t i = 0;
+		((p = Store(p, args, lengths[i++])), ...);
+	}
+	ring.Commit(r);
+	return true;
+}
+
+template<size_t NumSlots, size_t SlotSize> bool DeferredLog<NumSlots, SlotSize>::Peek(DeferredLogMessage& msg) noexcept
+{
+	for (;;)
+	{
+		size_t length;
+		const uint8_t *_ecv_array _ecv_null const record = ring.Peek(length);
+		if (record == nullptr)
+		{
+			return false;
+		}
+		if (msg.Decode(record, length))
+		{
+			return true;
+		}
+		ring.Pop();					// should never happen, but discard the record rather than getting stuck
+	}
+}
+
+#endif /* SRC_GENERAL_DEFERREDLOG_H_ */
@@ -0,0 +1,540 @@
+/*
+ * FloatToDecimal.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ *
+ *  A float is an integer mantissa of up to 24 bits multiplied by a power of 2. To multiply it exactly by a power of 10 we multiply or divide by the corresponding power of 5
+ *  using a small multi-word integer and then apply the combined power of 2 by shifting. Finding the shortest representation uses the same arithmetic to check whether a
+ *  candidate lies within the range of values that round to the float, in the same way as Ryu and Grisu but without their large tables of precomputed powers.
+ */
+
+#include "FloatToDecimal.h"
+#include <cstring>
+
+// Unsigned integer made of several 32-bit words, large enough for the calculations in this file
+class BigUint
+{
+public:
+	explicit BigUint(uint64_t v) noexcept;
+
+	void MultiplyBy(uint32_t m) noexcept;
+	uint32_t DivideBy(uint32_t d) noexcept;								// returns the remainder
+	void MultiplyByPowerOf5(unsigned int n) noexcept;
+	bool DivideByPowerOf5(unsigned int n) noexcept;						// returns true if there was a nonzero remainder
+	void ShiftLeft(unsigned int n) noexcept;
+
+	unsigned int BitLength() const noexcept;
+	bool GetBit(unsigned int n) const noexcept;
+	bool AnyBitsBelow(unsigned int n) const noexcept;
+	uint64_t GetBits(unsigned int lsb) const noexcept;					// returns the 64 bits starting at bit lsb
+	int Compare(const BigUint& other) const noexcept;
+
+private:
+	static constexpr unsigned int MaxWords = 8;
+
+	uint32_t words[MaxWords];
+	unsigned int numWords;												// the number of words in use, excluding leading zero words
+};
+
+BigUint::BigUint(uint64_t v) noexcept
+{
+	words[0] = (uint32_t)v;
+	words[1] = (uint32_t)(v >> 32);
+	numWords = (words[1] != 0) ? 2 : (words[0] != 0) ? 1 : 0;
+}
+
+void BigUint::MultiplyBy(uint32_t m) noexcept
+{
+	uint32_t carry = 0;
+	for (unsigned int i = 0; i < numWords; ++i)
+	{
+		const uint64_t product = (uint64_t)words[i] * m + carry;
+		words[i] = (uint32_t)product;
+		carry = (uint32_t)(product >> 32);
+	}
+	if (carry != 0 && numWords < MaxWords)
+	{
+		words[numWords++] = carry;
+	}
+}
+
+uint32_t BigUint::DivideBy(uint32_t d) noexcept
+{
+	uint32_t rem = 0;
+	for (unsigned int i = numWords; i != 0; )
+	{
+		--i;
+		const uint64_t dividend = ((uint64_t)rem << 32) | words[i];
+		words[i] = (uint32_t)(dividend/d);
+		rem = (uint32_t)(dividend % d);
+	}
+	while (numWords != 0 && words[numWords - 1] == 0)
+	{
+		--numWords;
+	}
+	return rem;
+}
+
+// 5^13 is the largest power of 5 that fits in 32 bits
+static constexpr unsigned int MaxPowerOf5InWord = 13;
+static constexpr uint32_t PowersOf5[MaxPowerOf5InWord + 1] =
+{
+	1, 5, 25, 125, 625, 3125, 15625, 78125, 390625, 1953125, 9765625, 48828125, 244140625, 1220703125
+};
+
+void BigUint::MultiplyByPowerOf5(unsigned int n) noexcept
+{
+	while (n != 0)
+	{
+		const unsigned int step = (n < MaxPowerOf5InWord) ? n : MaxPowerOf5InWord;
+		MultiplyBy(PowersOf5[step]);
+		n -= step;
+	}
+}
+
+bool BigUint::DivideByPowerOf5(unsigned int n) noexcept
+{
+	bool inexact = false;
+	while (n != 0)
+	{
+		const unsigned int step = (n < MaxPowerOf5InWord) ? n : MaxPowerOf5InWord;
+		if (DivideBy(PowersOf5[step]) != 0)
+		{
+			inexact = true;
+		}
+		n -= step;
+	}
+	return inexact;
+}
+
+void BigUint::ShiftLeft(unsigned int n) noexcept
+{
+	if (numWords == 0)
+	{
+		return;
+	}
+
+	const unsigned int wordShift = n/32, bitShift = n % 32;
+	unsigned int newNumWords = numWords + wordShift + 1;
+	if (newNumWords > MaxWords)
+	{
+		newNumWords = MaxWords;											// we never need numbers this big, so just avoid writing outside the array
+	}
+	for (unsigned int i = newNumWords; i != 0; )
+	{
+		--i;
+		const uint32_t hi = (i >= wordShift && i - wordShift < numWords) ? words[i - wordShift] : 0;
+		const uint32_t lo = (bitShift != 0 && i >= wordShift + 1 && i - wordShift - 1 < numWords) ? words[i - wordShift - 1] : 0;
+		words[i] = (bitShift == 0) ? hi : (hi << bitShift) | (lo >> (32 - bitShift));
+	}
+	numWords = newNumWords;
+	while (numWords != 0 && words[numWords - 1] == 0)
+	{
+		--numWords;
+	}
+}
+
+unsigned int BigUint::BitLength() const noexcept
+{
+	return (numWords == 0) ? 0 : 32 * numWords - (unsigned int)__builtin_clz(words[numWords - 1]);
+}
+
+bool BigUint::GetBit(unsigned int n) const noexcept
+{
+	return n/32 < numWords && (words[n/32] & (1u << (n % 32))) != 0;
+}
+
+bool BigUint::AnyBitsBelow(unsigned int n) const noexcept
+{
+	for (unsigned int i = 0; i < numWords && i * 32 < n; ++i)
+	{
+		const uint32_t mask = (n - i * 32 >= 32) ? 0xFFFFFFFFu : (1u << (n - i * 32)) - 1;
+		if ((words[i] & mask) != 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+uint64_t BigUint::GetBits(unsigned int lsb) const noexcept
+{
+	uint64_t result = 0;
+	const unsigned int firstWord = lsb/32, bitShift = lsb % 32;
+	for (unsigned int i = 0; i < 3; ++i)
+	{
+		const unsigned int w = firstWord + i;
+		if (w < numWords)
+		{
+			const int shift = (int)(i * 32) - (int)bitShift;
+			if (shift >= 0)
+			{
+				if (shift < 64)
+				{
+					result |= (uint64_t)words[w] << shift;
+				}
+			}
+			else
+			{
+				result |= (uint64_t)(words[w] >> -shift);
+			}
+		}
+	}
+	return result;
+}
+
+int BigUint::Compare(const BigUint& other) const noexcept
+{
+	if (numWords != other.numWords)
+	{
+		return (numWords > other.numWords) ? 1 : -1;
+	}
+	for (unsigned int i = numWords; i != 0; )
+	{
+		--i;
+		if (words[i] != other.words[i])
+		{
+			return (words[i] > other.words[i]) ? 1 : -1;
+		}
+	}
+	return 0;
+}
+
+// Split a float into mantissa and binary exponent so that its absolute value is mantissa * 2^binaryExponent
+static void Decompose(float f, uint32_t& mantissa, int& binaryExponent) noexcept
+{
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	const unsigned int biasedExponent = (bits >> 23) & 0xFFu;
+	mantissa = bits & 0x007FFFFFu;
+	if (biasedExponent == 0)
+	{
+		binaryExponent = -149;											// denormalised number
+	}
+	else
+	{
+		mantissa |= 0x00800000u;
+		binaryExponent = (int)biasedExponent - 150;
+	}
+}
+
+// Powers of 5 that fit in 64 bits, for the fast path of Scale
+static constexpr unsigned int MaxPowerOf5In64Bits = 27;
+static constexpr uint64_t PowersOf5In64Bits[MaxPowerOf5In64Bits + 1] =
+{
+	1, 5, 25, 125, 625, 3125, 15625, 78125, 390625, 1953125, 9765625, 48828125, 244140625, 1220703125,
+	6103515625, 30517578125, 152587890625, 762939453125, 3814697265625, 19073486328125, 95367431640625, 476837158203125,
+	2384185791015625, 11920928955078125, 59604644775390625, 298023223876953125, 1490116119384765625, 7450580596923828125
+};
+
+// A mantissa has at most 24 bits and 5^17 < 2^40, so the product of the mantissa and a power of 5 up to this one fits in 64 bits
+static constexpr unsigned int MaxPowerOf5ForMultiply = 17;
+
+// Apply a power of 2 to a 64-bit value, rounding to nearest even or truncating. 'inexact' is true if nonzero bits have already been discarded below the value.
+static bool ShiftAndRound(uint64_t n, int shift, bool inexact, bool round, uint64_t& result) noexcept
+{
+	if (shift >= 0)
+	{
+		if (shift >= 64 || (n >> (63 - shift)) > 1)
+		{
+			return false;
+		}
+		result = n << shift;
+		return true;
+	}
+
+	const unsigned int rightShift = (unsigned int)-shift;
+	if (rightShift > 64)
+	{
+		result = 0;														// the value is less than 0.5, so it rounds to zero
+		return true;
+	}
+	uint64_t quotient = (rightShift == 64) ? 0 : n >> rightShift;
+	const uint64_t roundingBit = (uint64_t)1 << (rightShift - 1);
+	if (round && (n & roundingBit) != 0 && (inexact || (quotient & 1u) != 0 || (n & (roundingBit - 1)) != 0))
+	{
+		++quotient;
+		if (quotient == 0)
+		{
+			return false;
+		}
+	}
+	result = quotient;
+	return true;
+}
+
+// Calculate mantissa * 2^binaryExponent * 10^power rounded to nearest even or truncated. Return false if the result doesn't fit in 64 bits.
+static bool Scale(uint32_t mantissa, int binaryExponent, int power, bool round, uint64_t& result) noexcept
+{
+	// Fast path for the common cases, e.g. printing with a few decimal places, in which the arithmetic fits in 64 bits so we don't need BigUint
+	if (power >= 0)
+	{
+		if ((unsigned int)power <= MaxPowerOf5ForMultiply)
+		{
+			return ShiftAndRound((uint64_t)mantissa * PowersOf5In64Bits[power], binaryExponent + power, false, round, result);
+		}
+	}
+	else if ((unsigned int)-power <= MaxPowerOf5In64Bits && binaryExponent + power < 64 - 24 - 1)
+	{
+		// Apply any left shift before dividing so that we don't lose precision, keeping one extra bit for rounding
+		int shift = binaryExponent + power;
+		uint64_t n = mantissa;
+		if (shift >= 0)
+		{
+			n <<= shift + 1;
+			shift = -1;
+		}
+		const uint64_t divisor = PowersOf5In64Bits[-power];
+		const uint64_t quotient = n/divisor;
+		return ShiftAndRound(quotient, shift, quotient * divisor != n, round, result);
+	}
+
+	BigUint n(mantissa);
+	int shift = binaryExponent + power;									// the power of 2 that remains to be applied
+	bool inexact = false;
+	if (power >= 0)
+	{
+		n.MultiplyByPowerOf5((unsigned int)power);
+	}
+	else
+	{
+		// Apply any left shift before dividing so that we don't lose precision, keeping one extra bit for rounding
+		if (shift >= 0)
+		{
+			n.ShiftLeft((unsigned int)shift + 1);
+			shift = -1;
+		}
+		inexact = n.DivideByPowerOf5((unsigned int)-power);
+	}
+
+	if (shift >= 0)
+	{
+		if (n.BitLength() + (unsigned int)shift > 64)
+		{
+			return false;
+		}
+		result = n.GetBits(0) << shift;
+		return true;
+	}
+
+	const unsigned int rightShift = (unsigned int)-shift;
+	if (n.BitLength() > rightShift + 64)
+	{
+		return false;
+	}
+	uint64_t quotient = n.GetBits(rightShift);
+	if (round && n.GetBit(rightShift - 1) && (inexact || (quotient & 1u) != 0 || n.AnyBitsBelow(rightShift - 1)))
+	{
+		++quotient;
+		if (quotient == 0)
+		{
+			return false;
+		}
+	}
+	result = quotient;
+	return true;
+}
+
+int FloatDecimalExponent(float f) noexcept
+{
+	uint32_t mantissa;
+	int binaryExponent;
+	Decompose(f, mantissa, binaryExponent);
+
+	// The value is at least 2^msb and less than 2^(msb + 1), so floor(msb * log10(2)) is either the answer or one less than it.
+	// 78913/2^18 is close enough to log10(2) for the range of exponents that floats have.
+	const int msb = binaryExponent + 31 - __builtin_clz(mantissa);
+	int exponent = (msb * 78913) >> 18;
+	uint64_t scaled;
+	if (!Scale(mantissa, binaryExponent, -(exponent + 1), false, scaled) || scaled != 0)
+	{
+		++exponent;
+	}
+	return exponent;
+}
+
+bool ScaleFloatToInteger(float f, int power, uint64_t& result) noexcept
+{
+	uint32_t mantissa;
+	int binaryExponent;
+	Decompose(f, mantissa, binaryExponent);
+	return Scale(mantissa, binaryExponent, power, true, result);
+}
+
+// Compare a * 5^a5 * 2^a2 with b * 2^b2, where a5 may be negative
+static int CompareScaled(uint64_t a, int a5, int a2, uint64_t b, int b2) noexcept
+{
+	BigUint x(a), y(b);
+	if (a5 >= 0)
+	{
+		x.MultiplyByPowerOf5((unsigned int)a5);
+	}
+	else
+	{
+		y.MultiplyByPowerOf5((unsigned int)-a5);
+	}
+	if (a2 > b2)
+	{
+		x.ShiftLeft((unsigned int)(a2 - b2));
+	}
+	else if (b2 > a2)
+	{
+		y.ShiftLeft((unsigned int)(b2 - a2));
+	}
+	return x.Compare(y);
+}
+
+unsigned int FloatToShortestDecimal(float f, uint32_t& digits, int& exponent) noexcept
+{
+	uint32_t mantissa;
+	int binaryExponent;
+	Decompose(f, mantissa, binaryExponent);
+	if (mantissa == 0)
+	{
+		digits = 0;
+		exponent = 0;
+		return 1;
+	}
+
+	// Any number strictly between the midpoints of f and its neighbours converts to f. The midpoints themselves convert to f if its mantissa is even.
+	// At a power of 2 the gap to the next lower float is half the gap to the next higher one.
+	const bool boundsConvert = (mantissa & 1u) == 0;
+	const bool lowerGapIsSmaller = (mantissa == 0x00800000u && binaryExponent > -149);
+	const uint64_t upperBound = 2 * (uint64_t)mantissa + 1;				// times 2^(binaryExponent - 1)
+	const uint64_t lowerBound = (lowerGapIsSmaller) ? 4 * (uint64_t)mantissa - 1 : 2 * (uint64_t)mantissa - 1;
+	const int lowerBoundExponent = (lowerGapIsSmaller) ? binaryExponent - 2 : binaryExponent - 1;
+
+	auto converts = [=](uint64_t candidate, int power) noexcept -> bool
+	{
+		// candidate * 10^-power == candidate * 5^-power * 2^-power
+		const int lowerCompare = CompareScaled(candidate, -power, -power, lowerBound, lowerBoundExponent);
+		if (lowerCompare < 0 || (lowerCompare == 0 && !boundsConvert))
+		{
+			return false;
+		}
+		const int upperCompare = CompareScaled(candidate, -power, -power, upperBound, binaryExponent - 1);
+		return upperCompare < 0 || (upperCompare == 0 && boundsConvert);
+	};
+
+	// Try the number of digits in increasing order. Nine digits are always enough to identify a float.
+	const int topExponent = FloatDecimalExponent(f);
+	unsigned int numDigits = 1;
+	uint64_t candidate;
+	int power;
+	for (;;)
+	{
+		power = (int)numDigits - 1 - topExponent;
+		(void)Scale(mantissa, binaryExponent, power, true, candidate);
+		if (numDigits >= 9 || converts(candidate, power))
+		{
+			break;
+		}
+
+		// The nearest candidate may lie just outside the smaller gap below f while the next one up is within the larger gap above it
+		if (lowerGapIsSmaller && converts(candidate + 1, power))
+		{
+			++candidate;
+			break;
+		}
+		++numDigits;
+	}
+
+	// Rounding up may have given us a trailing zero, e.g. if f is just below a power of 10
+	int exp = -power;
+	while (candidate >= 10 && candidate % 10 == 0)
+	{
+		candidate /= 10;
+		++exp;
+	}
+
+	digits = (uint32_t)candidate;
+	exponent = exp;
+	unsigned int count = 1;
+	for (uint32_t d = digits; d >= 10; d /= 10)
+	{
+		++count;
+	}
+	return count;
+}
+
+size_t FormatShortestFloat(char *_ecv_array buffer, size_t bufLen, float f) noexcept
+{
+	char temp[MaxShortestFloatLength];
+	size_t len = 0;
+
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	if ((bits & 0x80000000u) != 0)
+	{
+		temp[len++] = '-';
+	}
+
+	uint32_t digits;
+	int exponent;
+	const unsigned int numDigits = FloatToShortestDecimal(f, digits, exponent);
+	char digitChars[9] = { 0 };
+	for (unsigned int i = numDigits; i != 0; )
+	{
+		--i;
+		digitChars[i] = (char)('0' + digits % 10);
+		digits /= 10;
+	}
+
+	const int topExponent = exponent + (int)numDigits - 1;
+	if (numDigits == 1 && digitChars[0] == '0')
+	{
+		temp[len++] = '0';
+	}
+	else if (topExponent < -4 || topExponent >= 9)
+	{
+		// Exponent format with at least 2 exponent digits, like printf
+		temp[len++] = digitChars[0];
+		if (numDigits > 1)
+		{
+			temp[len++] = '.';
+			memcpy(temp + len, digitChars + 1, numDigits - 1);
+			len += numDigits - 1;
+		}
+		temp[len++] = 'e';
+		temp[len++] = (topExponent < 0) ? '-' : '+';
+		const unsigned int absExponent = (unsigned int)((topExponent < 0) ? -topExponent : topExponent);
+		temp[len++] = (char)('0' + absExponent/10);
+		temp[len++] = (char)('0' + absExponent % 10);
+	}
+	else if (topExponent < 0)
+	{
+		temp[len++] = '0';
+		temp[len++] = '.';
+		for (int i = -1; i > topExponent; --i)
+		{
+			temp[len++] = '0';
+		}
+		memcpy(temp + len, digitChars, numDigits);
+		len += numDigits;
+	}
+	else
+	{
+		const unsigned int digitsBeforePoint = (unsigned int)topExponent + 1;
+		for (unsigned int i = 0; i < digitsBeforePoint; ++i)
+		{
+			temp[len++] = (i < numDigits) ? digitChars[i] : '0';
+		}
+		if (numDigits > digitsBeforePoint)
+		{
+			temp[len++] = '.';
+			memcpy(temp + len, digitChars + digitsBeforePoint, numDigits - digitsBeforePoint);
+			len += numDigits - digitsBeforePoint;
+		}
+	}
+
+	if (bufLen != 0)
+	{
+		const size_t toCopy = (len < bufLen) ? len : bufLen - 1;
+		memcpy(buffer, temp, toCopy);
+		buffer[toCopy] = 0;
+	}
+	return len;
+}
+
+// End
@@ -0,0 +1,39 @@
+/*
+ * FloatToDecimal.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ *
+ *  Exact conversion of single precision floating point numbers to decimal using integer arithmetic only
+ */
+
+#ifndef SRC_GENERAL_FLOATTODECIMAL_H_
+#define SRC_GENERAL_FLOATTODECIMAL_H_
+
+#include "../ecv_duet3d.h"
+#include <cstdint>
+#include <cstddef>
+
+// These functions don't use any floating point operations, so they are fast on processors that have no FPU or only a single precision FPU.
+// The results are exact, unlike those of repeatedly multiplying or dividing by 10.
+// The sign of the float is ignored. The float must be finite.
+
+// Return the power of 10 of the most significant decimal digit of f, i.e. floor(log10(f)). f must not be zero.
+int FloatDecimalExponent(float f) noexcept;
+
+// Calculate f * 10^power rounded to the nearest integer, with ties rounded to even. Return false if the result is too large to fit in 64 bits.
+bool ScaleFloatToInteger(float f, int power, uint64_t& result) noexcept;
+
+// Find the shortest string of decimal digits that converts back to f, so that f is represented by digits * 10^exponent.
+// Where there is more than one such string of the same length, the one nearest to f is chosen. Return the number of digits, which is never more than 9.
+unsigned int FloatToShortestDecimal(float f, uint32_t& digits, int& exponent) noexcept;
+
+// Store the shortest representation of f that converts back to the same value, e.g. "0.1", "-2.5e-07" or "3.4028235e+38", followed by a null terminator.
+// Exponent format is used if the number is less than 1e-4 or at least 1e9. Return the length excluding the terminator, which is never more than 15.
+// If the buffer is too small then the output is truncated.
+size_t FormatShortestFloat(char *_ecv_array buffer, size_t bufLen, float f) noexcept;
+
+// Length of the buffer needed by FormatShortestFloat for any float, including the terminator
+constexpr size_t MaxShortestFloatLength = 16;
+
+#endif /* SRC_GENERAL_FLOATTODECIMAL_H_ */
@@ -0,0 +1,331 @@
+/*
+ * FormatString.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ *
+ *  Format strings that are parsed and checked against the argument types at compile time
+ */
+
+#ifndef SRC_GENERAL_FORMATSTRING_H_
+#define SRC_GENERAL_FORMATSTRING_H_
+
+#include "../ecv_duet3d.h"
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include "SafeVsnprintf.h"
+#include "StringRef.h"
+
+// Wrap a string literal so that it can be passed to FormatPrint, FormatPrintf or FormatCatf, e.g. FormatCatf(reply, FORMAT_LITERAL("X%.2f Y%.2f"), x, y).
+// C++17 doesn't allow string literals as template arguments, so we define a class whose type carries the literal instead.
+// The format is parsed when the program is compiled, so at run time only the literal text and the conversions are printed.
+// The number and types of the arguments are checked against the format, so a mismatch gives a compile-time error instead of bad output.
+// The same conversions as uprintf are supported, except that '*' can't be used for the width or precision.
+// Each use creates a separate instance of the template functions, so use this for formats that are printed often and keep using catf for the others.
+#define FORMAT_LITERAL(_s) ([]() noexcept { struct FormatLiteral { static constexpr const char *_ecv_array Get() noexcept { return _s; } }; return FormatLiteral(); }())
+
+namespace FormatString
+{
+	// One step of a parsed format: some literal text followed by an optional conversion
+	struct Step
+	{
+		uint16_t literalStart;
+		uint16_t literalLength;
+		FormatConversion conv;
+	};
+
+	template<size_t N> struct ParsedFormat
+	{
+		Step steps[N];
+		size_t numSteps;
+		size_t numConversions;
+		bool valid;
+	};
+
+	// Return the maximum number of steps needed for a format string. Each step except the last ends with a '%'.
+	constexpr size_t MaxSteps(const char *_ecv_array s) noexcept
+	{
+		size_t n = 1;
+		for (; *s != 0; ++s)
+		{
+			if (*s == '%')
+			{
+				++n;
+			}
+		}
+		return n;
+	}
+
+	constexpr bool IsDigit(char c) noexcept { return c >= '0' && c <= '9'; }
+
+	constexpr bool IsIntegerConversion(char c) noexcept
+	{
+		return c == 'd' || c == 'i' || c == 'u' || c == 'x' || c == 'X' || c == 'o' || c == 'p';
+	}
+
+	constexpr bool IsFloatConversion(char c) noexcept
+	{
+		return c == 'f' || c == 'e' || c == 'g' || c == 'F' || c == 'E' || c == 'G';
+	}
+
+	// Parse a format string in the same way as FormattedPrinter::Print
+	template<size_t N> constexpr ParsedFormat<N> Parse(const char *_ecv_array s) noexcept
+	{
+		ParsedFormat<N> result{};
+		size_t pos = 0, literalStart = 0;
+		for (;;)
+		{
+			while (s[pos] != 0 && s[pos] != '%')
+			{
+				++pos;
+			}
+
+			Step& step = result.steps[result.numSteps++];
+			step.literalStart = (uint16_t)literalStart;
+			step.conv = FormatConversion{ 0, 0, 0, -1 };
+			if (s[pos] == 0)
+			{
+				step.literalLength = (uint16_t)(pos - literalStart);
+				result.valid = true;
+				return result;
+			}
+			if (s[pos + 1] == '%')
+			{
+				// Print the first '%' as part of the literal and skip the second one
+				step.literalLength = (uint16_t)(pos + 1 - literalStart);
+				pos += 2;
+				literalStart = pos;
+				continue;
+			}
+
+			step.literalLength = (uint16_t)(pos - literalStart);
+			const size_t specStart = pos++;
+			FormatConversion& conv = step.conv;
+			for (bool moreFlags = true; moreFlags; )
+			{
+				switch (s[pos])
+				{
+				case '#':	conv.flags |= FormatConversion::Hash; ++pos; break;
+				case '-':	conv.flags |= FormatConversion::PadRight; ++pos; break;
+				case '0':	conv.flags |= FormatConversion::PadZero; ++pos; break;
+				case '+':	conv.flags |= FormatConversion::ForceSign; ++pos; break;
+				case ' ':	conv.flags |= FormatConversion::SignOrSpace; ++pos; break;
+				default:	moreFlags = false; break;
+				}
+			}
+			while (IsDigit(s[pos]))
+			{
+				conv.width = (int16_t)(conv.width * 10 + (s[pos++] - '0'));
+			}
+			if (s[pos] == '.')
+			{
+				++pos;
+				conv.precision = 0;
+				while (IsDigit(s[pos]))
+				{
+					conv.precision = (int16_t)(conv.precision * 10 + (s[pos++] - '0'));
+				}
+				if (s[pos] == 's' && pos == specStart + 2)
+				{
+					conv.flags |= FormatConversion::Json;				// RRF extension: "%.s" prints a JSON-escaped string
+				}
+			}
+
+			bool hasModifier = false;
+			if (s[pos] == 'h')
+			{
+				++pos;
+				hasModifier = true;
+			}
+			else if (s[pos] == 'l')
+			{
+				++pos;
+				hasModifier = true;
+				if (s[pos] == 'l')
+				{
+					++pos;
+					conv.flags |= FormatConversion::Long64;
+				}
+			}
+
+			const char letter = s[pos];
+			if (!(IsIntegerConversion(letter) || (!hasModifier && (IsFloatConversion(letter) || letter == 's' || letter == 'c'))))
+			{
+				return result;													// unsupported conversion, '*', or '%' at the end
+			}
+			conv.letter = letter;
+			++result.numConversions;
+			literalStart = ++pos;
+		}
+	}
+
+	// Parsed format for a class created by FORMAT_LITERAL
+	template<class F> struct Parsed
+	{
+		static constexpr size_t MaxNumSteps = MaxSteps(F::Get());
+		static constexpr ParsedFormat<MaxNumSteps> value = Parse<MaxNumSteps>(F::Get());
+	};
+
+	enum class ArgKind : uint8_t { integer, longInteger, floatingPoint, string, pointer, other };
+
+	template<class T> constexpr ArgKind KindOf() noexcept
+	{
+		typedef typename std::decay<T>::type U;
+		if constexpr (std::is_integral<U>::value || std::is_enum<U>::value)
+		{
+			return (sizeof(U) > sizeof(int)) ? ArgKind::longInteger : ArgKind::integer;
+		}
+		else if constexpr (std::is_floating_point<U>::value)
+		{
+			return ArgKind::floatingPoint;
+		}
+		else if constexpr (std::is_same<U, const char *>::value || std::is_same<U, char *>::value || std::is_same<U, std::nullptr_t>::value)
+		{
+			return ArgKind::string;
+		}
+		else if constexpr (std::is_pointer<U>::value)
+		{
+			return ArgKind::pointer;
+		}
+		else
+		{
+			return ArgKind::other;
+		}
+	}
+
+	// Return true if an argument of the specified kind can be printed by a conversion. Values longer than int need the "ll" modifier.
+	constexpr bool Accepts(const FormatConversion& conv, ArgKind kind) noexcept
+	{
+		switch (conv.letter)
+		{
+		case 'p':
+			return kind == ArgKind::pointer || kind == ArgKind::string;
+		case 's':
+			return kind == ArgKind::string;
+		case 'c':
+			return kind == ArgKind::integer;
+		default:
+			return (IsFloatConversion(conv.letter)) ? kind == ArgKind::floatingPoint
+					: (conv.flags & FormatConversion::Long64) ? (kind == ArgKind::integer || kind == ArgKind::longInteger)
+						: kind == ArgKind::integer;
+		}
+	}
+
+	template<class F, class... Args> constexpr bool ArgsMatch() noexcept
+	{
+		constexpr ArgKind kinds[] = { KindOf<Args>()..., ArgKind::other };
+		size_t argIndex = 0;
+		for (size_t i = 0; i < Parsed<F>::value.numSteps; ++i)
+		{
+			const FormatConversion& conv = Parsed<F>::value.steps[i].conv;
+			if (conv.letter != 0)
+			{
+				if (argIndex >= sizeof...(Args) || !Accepts(conv, kinds[argIndex]))
+				{
+					return false;
+				}
+				++argIndex;
+			}
+		}
+		return true;
+	}
+
+	template<class T> inline bool PrintArg(ConversionPrinter& printer, const FormatConversion& conv, const T& arg) noexcept
+	{
+		typedef typename std::decay<T>::type U;
+		if constexpr (std::is_floating_point<U>::value)
+		{
+			return printer.PrintFloat(conv, (double)arg);
+		}
+		else if constexpr (std::is_same<U, std::nullptr_t>::value)
+		{
+			return printer.PrintString(conv, nullptr);
+		}
+		else if constexpr (std::is_pointer<U>::value)
+		{
+			if constexpr (std::is_same<typename std::remove_cv<typename std::remove_pointer<U>::type>::type, char>::value)
+			{
+				if (conv.letter == 's')
+				{
+					return printer.PrintString(conv, arg);
+				}
+			}
+			return printer.PrintInteger(conv, (long long)(uintptr_t)arg);
+		}
+		else
+		{
+			return printer.PrintInteger(conv, (long long)arg);
+		}
+	}
+
+	// Print the steps up to and including the next conversion, which prints 'arg'
+	template<class T> inline bool PrintNext(ConversionPrinter& printer, const char *_ecv_array fmt, const Step *_ecv_array steps, size_t& index, const T& arg) noexcept
+	{
+		while (steps[index].conv.letter == 0)
+		{
+			if (!printer.PrintLiteral(fmt + steps[index].literalStart, steps[index].literalLength))
+			{
+				return false;
+			}
+			++index;
+		}
+		const Step& step = steps[index++];
+		return printer.PrintLiteral(fmt + step.literalStart, step.literalLength) && PrintArg(printer, step.conv, arg);
+	}
+
+	template<class F, class... Args> int Print(PrintSink& sink, const Args&... args) noexcept
+	{
+		typedef Parsed<F> P;
+		static_assert(P::value.valid, "Unsupported conversion in format string");
+		static_assert(P::value.numConversions == sizeof...(Args), "Number of arguments doesn't match format string");
+		static_assert(ArgsMatch<F, Args...>(), "Argument type doesn't match format string");
+
+		const char *_ecv_array const fmt = F::Get();
+		ConversionPrinter printer(sink);
+		size_t index = 0;
+		if (!(true && ... && PrintNext(printer, fmt, P::value.steps, index, args)))
+		{
+			return printer.GetLength();
+		}
+		for (; index < P::value.numSteps; ++index)
+		{
+			if (!printer.PrintLiteral(fmt + P::value.steps[index].literalStart, P::value.steps[index].literalLength))
+			{
+				return printer.GetLength();
+			}
+		}
+		return printer.Finish();
+	}
+}
+
+// Print to a sink using a format wrapped by FORMAT_LITERAL, returning the number of characters printed
+template<class F, class... Args> inline int FormatPrint(PrintSink& sink, F, const Args&... args) noexcept
+{
+	return FormatString::Print<F>(sink, args...);
+}
+
+// Equivalent of StringRef::printf using a format wrapped by FORMAT_LITERAL
+template<class F, class... Args> int FormatPrintf(const StringRef& ref, F, const Args&... args) noexcept
+{
+	BufferSink sink(ref.Pointer(), ref.Capacity() + 1);
+	const int ret = FormatString::Print<F>(sink, args...);
+	sink.Terminate();
+	return ret;
+}
+
+// Equivalent of StringRef::catf using a format wrapped by FORMAT_LITERAL
+template<class F, class... Args> int FormatCatf(const StringRef& ref, F, const Args&... args) noexcept
+{
+	const size_t n = ref.strlen();
+	if (n < ref.Capacity())		// if room for at least 1 more character and a null
+	{
+		BufferSink sink(ref.Pointer() + n, ref.Capacity() + 1 - n);
+		const int ret = FormatString::Print<F>(sink, args...);
+		sink.Terminate();
+		return ret + (int)n;
+	}
+	return 0;
+}
+
+#endif /* SRC_GENERAL_FORMATSTRING_H_ */
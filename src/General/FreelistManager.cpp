@@ -0,0 +1,455 @@
+/*
+ * FreelistManager.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ */
+
+#include "FreelistManager.h"
+
+#ifdef FREELIST_STATS
+# include "StringRef.h"
+# include <cinttypes>
+#endif
+
+namespace FreelistManager
+{
+	FreelistBase *_ecv_null FreelistBase::sizeClassList = nullptr;
+	LowMemoryCallback _ecv_null FreelistBase::lowMemoryCallback = nullptr;
+
+#ifdef FREELIST_HOST_THREADS
+	std::mutex FreelistLocker::mutex;
+#endif
+
+	// Add this size class to the list if we haven't already
+	void FreelistBase::Register() noexcept
+	{
+		if (!registered)
+		{
+			FreelistLocker lock;
+			if (!registered)
+			{
+				next = sizeClassList;
+				sizeClassList = this;
+				registered = true;
+			}
+		}
+	}
+
+	// Allocate an item from the heap, after adding this size class to the list if we haven't already. Not safe to call from an ISR.
+	// If the heap is exhausted, return the free items of other size classes to it and try again.
+	void *FreelistBase::AllocateFromHeap() noexcept
+	{
+		Register();
+#ifdef FREELIST_STATS
+		AddToCounter(misses, 1);
+#endif
+		void *_ecv_null p = ::operator new(itemSize, std::nothrow);
+		if (p == nullptr)
+		{
+			(void)TrimAll(NoLimit);
+			p = ::operator new(itemSize, std::nothrow);
+			if (p == nullptr)
+			{
+				if (lowMemoryCallback != nullptr)
+				{
+					lowMemoryCallback(itemSize);
+				}
+				p = ::operator new(itemSize);
+			}
+		}
+		return not_null(p);
+	}
+
+	// Return an item to the heap if we can, returning true if successful. Called when the shared free list is full.
+	bool FreelistBase::ReleaseToHeap(void *p) noexcept
+	{
+#ifdef FREELIST_LOCK_FREE
+		if (IsInInterrupt())
+		{
+			return false;								// the heap can't be used from an ISR
+		}
+#endif
+		if (IsInSlab(p))
+		{
+			return false;
+		}
+		::operator delete(p);
+		return true;
+	}
+
+	// Return true if the item is part of a slab allocated by Reserve
+	bool FreelistBase::IsInSlab(const void *p) const noexcept
+	{
+		for (const Slab *_ecv_null slab = slabs; slab != nullptr; slab = slab->next)
+		{
+			const char *const start = reinterpret_cast<const char *>(slab + 1);
+			if (p >= start && p < start + slab->count * itemSize)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Return free items from the shared list to the heap until at least targetBytes have been freed or the list is empty, returning the number of bytes freed
+	size_t FreelistBase::Trim(size_t targetBytes) noexcept
+	{
+		size_t bytesFreed = 0;
+		void *_ecv_null keptFirst = nullptr;
+		void *_ecv_null keptLast = nullptr;
+		size_t numKept = 0;
+		while (bytesFreed < targetBytes)
+		{
+			void *_ecv_null const p = Pop();
+			if (p == nullptr)
+			{
+				break;
+			}
+			if (IsInSlab(not_null(p)))
+			{
+				// Keep items in slabs, and put them back on the list when we have finished
+				*reinterpret_cast<void *_ecv_null *>(p) = keptFirst;
+				keptFirst = p;
+				if (keptLast == nullptr)
+				{
+					keptLast = p;
+				}
+				++numKept;
+			}
+			else
+			{
+				::operator delete(not_null(p));
+				bytesFreed += itemSize;
+			}
+		}
+		if (numKept != 0)
+		{
+			PushChain(not_null(keptFirst), not_null(keptLast), numKept);
+		}
+		return bytesFreed;
+	}
+
+	// Return free items from all size classes to the heap until at least targetBytes have been freed, returning the number of bytes freed.
+	// Size classes that have more free items than their limit are trimmed first.
+	size_t FreelistBase::TrimAll(size_t targetBytes) noexcept
+	{
+#ifdef FREELIST_TASK_CACHE
+		TaskCache::FlushCurrent();
+#endif
+		size_t bytesFreed = 0;
+		for (FreelistBase *_ecv_null fl = sizeClassList; fl != nullptr && bytesFreed < targetBytes; fl = fl->next)
+		{
+			const uint32_t numFree = fl->GetFreeCount();
+			if (numFree > fl->maxFree)
+			{
+				const size_t surplusBytes = (numFree - fl->maxFree) * fl->itemSize;
+				bytesFreed += fl->Trim((surplusBytes < targetBytes - bytesFreed) ? surplusBytes : targetBytes - bytesFreed);
+			}
+		}
+		for (FreelistBase *_ecv_null fl = sizeClassList; fl != nullptr && bytesFreed < targetBytes; fl = fl->next)
+		{
+			bytesFreed += fl->Trim(targetBytes - bytesFreed);
+		}
+		return bytesFreed;
+	}
+
+	// Add a chain of 'count' items linked through their first words to the front of the free list
+	void FreelistBase::PushChain(void *first, void *last, size_t count) noexcept
+	{
+#ifdef FREELIST_LOCK_FREE
+		do
+		{
+			*reinterpret_cast<void *_ecv_null *>(last) = LoadExclusive(&freelist);
+		} while (!StoreExclusive(&freelist, first));
+#else
+		FreelistLocker lock;
+		*reinterpret_cast<void *_ecv_null *>(last) = freelist;
+		freelist = first;
+#endif
+		AddToCounter(freeCount, (int32_t)count);
+	}
+
+#ifdef FREELIST_TASK_CACHE
+
+	// Remove up to maxCount items from the free list and return them linked through their first words, setting 'count' to the number removed
+	void *_ecv_null FreelistBase::PopChain(size_t maxCount, size_t& count) noexcept
+	{
+		count = 0;
+# ifdef FREELIST_LOCK_FREE
+		// We can't safely follow the links in the list between LDREX and STREX because another task or ISR may pop the items meanwhile and overwrite the links, so pop the items one at a time
+		void *_ecv_null first = nullptr;
+		while (count < maxCount)
+		{
+			void *_ecv_null const p = Pop();
+			if (p == nullptr)
+			{
+				break;
+			}
+			*reinterpret_cast<void *_ecv_null *>(p) = first;
+			first = p;
+			++count;
+		}
+		return first;
+# else
+		FreelistLocker lock;
+		void *_ecv_null const first = freelist;
+		if (first != nullptr)
+		{
+			void *last = not_null(first);
+			count = 1;
+			while (count < maxCount && *reinterpret_cast<void *_ecv_null *>(last) != nullptr)
+			{
+				last = not_null(*reinterpret_cast<void *_ecv_null *>(last));
+				++count;
+			}
+			freelist = *reinterpret_cast<void *_ecv_null *>(last);
+			AddToCounter(freeCount, -(int32_t)count);
+		}
+		return first;
+# endif
+	}
+
+#endif
+
+	// Allocate one contiguous slab of 'count' items from the heap and add them to the free list, returning false if there was not enough memory.
+	// The items are linked in address order, so that objects allocated one after another are adjacent.
+	bool FreelistBase::Reserve(size_t count) noexcept
+	{
+		if (count == 0)
+		{
+			return true;
+		}
+
+		Slab *_ecv_null const slab = static_cast<Slab *_ecv_null>(::operator new(sizeof(Slab) + count * itemSize, std::nothrow));
+		if (slab == nullptr)
+		{
+			return false;
+		}
+
+		Register();
+		slab->count = count;
+		{
+			FreelistLocker lock;
+			slab->next = slabs;
+			slabs = slab;
+		}
+
+		char *const items = reinterpret_cast<char *_ecv_array>(slab + 1);
+		for (size_t i = 0; i + 1 < count; ++i)
+		{
+			*reinterpret_cast<void **>(items + i * itemSize) = items + (i + 1) * itemSize;
+		}
+		PushChain(items, items + (count - 1) * itemSize, count);
+		return true;
+	}
+
+#ifdef FREELIST_TASK_CACHE
+
+# ifdef FREELIST_HOST_THREADS
+
+	// Class to hold the cache pointer for each thread and flush the cache when the thread exits
+	class ThreadCacheHolder
+	{
+	public:
+		~ThreadCacheHolder() noexcept { TaskCache::Flush(cache); }
+
+		TaskCache *_ecv_null cache = nullptr;
+	};
+
+	static thread_local ThreadCacheHolder threadCacheHolder;
+
+# endif
+
+	TaskCache::TaskCache() noexcept
+	{
+		for (size_t i = 0; i < NumEntries; ++i)
+		{
+			heads[i] = nullptr;
+			counts[i] = 0;
+		}
+	}
+
+	// Return a reference to the cache pointer for the current task, or nullptr if we are in an ISR or the caller is not a task
+	TaskCache *_ecv_null *_ecv_null TaskCache::GetCurrentCachePointer() noexcept
+	{
+# if defined(RTOS)
+		if (IsInInterrupt())
+		{
+			return nullptr;
+		}
+		TaskBase *_ecv_from _ecv_null const me = TaskBase::GetCallerTaskHandle();
+		return (me == nullptr) ? nullptr : &not_null(me)->GetFreelistCache();
+# elif defined(FREELIST_HOST_THREADS)
+		return &threadCacheHolder.cache;
+# else
+		return nullptr;
+# endif
+	}
+
+	// Return the cache of the current task, creating it if necessary, or nullptr
+	TaskCache *_ecv_null TaskCache::GetCurrent() noexcept
+	{
+		TaskCache *_ecv_null *_ecv_null const cachePointer = GetCurrentCachePointer();
+		if (cachePointer == nullptr)
+		{
+			return nullptr;
+		}
+		if (*cachePointer == nullptr)
+		{
+			void *_ecv_null const mem = ::operator new(sizeof(TaskCache), std::nothrow);
+			if (mem != nullptr)
+			{
+				*cachePointer = new (mem) TaskCache;
+			}
+		}
+		return *cachePointer;
+	}
+
+	// Allocate an item from the cache of the current task, refilling the cache from the shared list if necessary
+	void *_ecv_null TaskCache::Allocate(FreelistBase& fl) noexcept
+	{
+		TaskCache *_ecv_null const cache = GetCurrent();
+		if (cache == nullptr)
+		{
+			return nullptr;
+		}
+
+		const size_t index = fl.cacheIndex;
+		void *_ecv_null p = cache->heads[index];
+		if (p == nullptr)
+		{
+			// Move a batch of items from the shared list, then allocate the first of them
+			size_t count;
+			p = fl.PopChain(BatchSize, count);
+			if (p == nullptr)
+			{
+				return fl.AllocateFromHeap();
+			}
+			cache->counts[index] = (uint8_t)count;
+		}
+		cache->heads[index] = (cache->counts[index] == 1) ? nullptr : *reinterpret_cast<void *_ecv_null *>(p);
+		--cache->counts[index];
+		return p;
+	}
+
+	// Release an item to the cache of the current task, moving a batch of items to the shared list if the cache is full
+	bool TaskCache::Release(FreelistBase& fl, void *p) noexcept
+	{
+		TaskCache *_ecv_null const cache = GetCurrent();
+		if (cache == nullptr)
+		{
+			return false;
+		}
+
+		const size_t index = fl.cacheIndex;
+		if (cache->counts[index] >= MaxItemsPerEntry)
+		{
+			// Move the newest BatchSize items to the shared list, keeping the older ones
+			void *const first = not_null(cache->heads[index]);
+			void *last = first;
+			for (size_t i = 1; i < BatchSize; ++i)
+			{
+				last = not_null(*reinterpret_cast<void *_ecv_null *>(last));
+			}
+			cache->heads[index] = *reinterpret_cast<void *_ecv_null *>(last);
+			cache->counts[index] -= BatchSize;
+			if (ReadCounter(fl.freeCount) < fl.maxFree)
+			{
+				fl.PushChain(first, last, BatchSize);
+			}
+			else
+			{
+				// The shared list is full, so return these items to the heap unless they belong to a slab
+				void *_ecv_null q = first;
+				for (size_t i = 0; i < BatchSize; ++i)
+				{
+					void *const item = not_null(q);
+					q = *reinterpret_cast<void *_ecv_null *>(item);
+					if (!fl.ReleaseToHeap(item))
+					{
+						fl.Push(item);
+					}
+				}
+			}
+		}
+		*reinterpret_cast<void *_ecv_null *>(p) = cache->heads[index];
+		cache->heads[index] = p;
+		++cache->counts[index];
+		return true;
+	}
+
+	// Return all the items in a cache to the shared lists, then delete the cache and set the pointer to null. The task that owned it must not be running.
+	void TaskCache::Flush(TaskCache *_ecv_null& cache) noexcept
+	{
+		TaskCache *_ecv_null const c = cache;
+		if (c != nullptr)
+		{
+			cache = nullptr;
+
+			// Only registered size classes can have items in a cache, because the items were allocated either from the heap or from a list that was registered or reserved
+			for (FreelistBase *_ecv_null fl = FreelistBase::sizeClassList; fl != nullptr; fl = fl->next)
+			{
+				const size_t index = fl->cacheIndex;
+				if (index != FreelistBase::NotCached && c->counts[index] != 0)
+				{
+					void *const first = not_null(c->heads[index]);
+					void *last = first;
+					for (size_t i = 1; i < c->counts[index]; ++i)
+					{
+						last = not_null(*reinterpret_cast<void *_ecv_null *>(last));
+					}
+					fl->PushChain(first, last, c->counts[index]);
+				}
+			}
+			c->~TaskCache();
+			::operator delete(c);
+		}
+	}
+
+	// Flush the cache of the calling task, if it has one
+	void TaskCache::FlushCurrent() noexcept
+	{
+		TaskCache *_ecv_null *_ecv_null const cachePointer = GetCurrentCachePointer();
+		if (cachePointer != nullptr)
+		{
+			Flush(*cachePointer);
+		}
+	}
+
+#endif
+
+#ifdef FREELIST_STATS
+
+	// Record the number of items outstanding if it is a new maximum. Other tasks or ISRs may be allocating and releasing items at the same time, so the value may be slightly out.
+	void FreelistBase::UpdatePeakOutstanding() noexcept
+	{
+		const int32_t outstanding = (int32_t)GetOutstanding();
+		if (outstanding > 0)
+		{
+			MaxIntoCounter(peakOutstanding, (uint32_t)outstanding);
+		}
+	}
+
+	// Append a line reporting the statistics for this size class to 'reply'
+	void FreelistBase::AppendReport(const StringRef& reply) const noexcept
+	{
+		reply.lcatf("Size %u: allocs %" PRIu32 " hits %" PRIu32 " misses %" PRIu32 " releases %" PRIu32 " free %" PRIu32 " (%u bytes) outstanding %" PRIu32 " peak %" PRIu32,
+						(unsigned int)itemSize, GetAllocations(), GetHits(), GetMisses(), GetReleases(), GetFreeCount(), (unsigned int)(GetFreeCount() * itemSize),
+						GetOutstanding(), GetPeakOutstanding());
+	}
+
+	// Report the statistics for all size classes that have been used
+	void FreelistBase::ReportAll(const StringRef& reply) noexcept
+	{
+		for (const FreelistBase *_ecv_null fl = sizeClassList; fl != nullptr; fl = fl->next)
+		{
+			fl->AppendReport(reply);
+		}
+	}
+
+#endif
+
+}
+
+// End
@@ -10,52 +10,394 @@
 #ifndef SRC_LIBRARIES_GENERAL_FREELISTMANAGER_H_
 #define SRC_LIBRARIES_GENERAL_FREELISTMANAGER_H_
 
+#include "../ecv_duet3d.h"
 #include <cstddef>
+#include <cstdint>
 #include <new>
 #ifdef RTOS
 # include "../RTOSIface/RTOSIface.h"
 #endif
 
+// On ARMv7-M processors running an RTOS we manage the free lists without locking, using the LDREX and STREX instructions.
+// A STREX fails if any other store to the list head has occurred since the LDREX, and also if there has been an exception (and hence a task switch) in between.
+// So popping an item can't suffer from the ABA problem, and the lists can be used from ISRs as well as tasks.
+// On other processors we suspend task scheduling instead, so the lists must not be used from ISRs.
+// If FREELIST_STATS is defined, each size class also keeps allocation statistics.
+#if defined(RTOS) && (defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__))
+# define FREELIST_LOCK_FREE		1
+#endif
+
+// If FREELIST_TASK_CACHE is defined, each task keeps a small cache of free items of each size up to FREELIST_CACHE_MAX_ITEM_SIZE bytes.
+// A task allocates from and releases to its own cache without locking, and items are moved between the cache and the shared free list FREELIST_CACHE_BATCH_SIZE at a time.
+// ISRs bypass the caches. When a task terminates, the items in its cache are returned to the shared lists.
+// On a host without an RTOS, each thread has its own cache and the shared lists are protected by a mutex, so that the scaling can be measured.
+#ifdef FREELIST_TASK_CACHE
+# ifndef FREELIST_CACHE_MAX_ITEM_SIZE
+#  define FREELIST_CACHE_MAX_ITEM_SIZE	(128)
+# endif
+# ifndef FREELIST_CACHE_BATCH_SIZE
+#  define FREELIST_CACHE_BATCH_SIZE		(8)
+# endif
+# if !defined(RTOS) && !defined(__arm__)
+#  define FREELIST_HOST_THREADS		1
+#  include <mutex>
+# endif
+#endif
+
+#if defined(FREELIST_LOCK_FREE) || defined(FREELIST_HOST_THREADS)
+# include <atomic>
+#endif
+
+class StringRef;
+
 namespace FreelistManager
 {
-	// Free list manager class
-	template<size_t Sz> class Freelist
+#ifdef FREELIST_LOCK_FREE
+
+	inline void *_ecv_null LoadExclusive(void *_ecv_null volatile *addr) noexcept
+	{
+		void *_ecv_null result;
+		asm volatile("ldrex %0, [%1]" : "=r" (result) : "r" (addr) : "memory");
+		return result;
+	}
+
+	// Returns true if the store succeeded
+	inline bool StoreExclusive(void *_ecv_null volatile *addr, void *_ecv_null val) noexcept
+	{
+		uint32_t failed;
+		asm volatile("strex %0, %2, [%1]" : "=&r" (failed) : "r" (addr), "r" (val) : "memory");
+		return failed == 0;
+	}
+
+	inline void ClearExclusive() noexcept
+	{
+		asm volatile("clrex" : : : "memory");
+	}
+
+#endif
+
+	// Class to lock the shared free lists while we manipulate them when they are not lock-free
+	class FreelistLocker
 	{
 	public:
-		static void *AllocateItem() noexcept;
-		static void ReleaseItem(void *p) noexcept;
+		FreelistLocker() noexcept
+#ifdef FREELIST_HOST_THREADS
+			: lock(mutex)
+#endif
+		{ }
 
 	private:
-		static void * null freelist;
+#if defined(RTOS)
+		TaskCriticalSectionLocker lock;
+#elif defined(FREELIST_HOST_THREADS)
+		std::lock_guard<std::mutex> lock;
+		static std::mutex mutex;
+#endif
 	};
 
-	template<size_t Sz> void *null Freelist<Sz>::freelist = nullptr;
+	// Counters of items. When the free lists are lock-free or used by several threads these must be updated atomically, otherwise they are only updated with task scheduling suspended.
+#if defined(FREELIST_LOCK_FREE) || defined(FREELIST_HOST_THREADS)
+	typedef std::atomic<uint32_t> ItemCounter;
+	inline void AddToCounter(ItemCounter& c, int32_t n) noexcept { c.fetch_add((uint32_t)n, std::memory_order_relaxed); }
+	inline uint32_t ReadCounter(const ItemCounter& c) noexcept { return c.load(std::memory_order_relaxed); }
+	inline void MaxIntoCounter(ItemCounter& c, uint32_t n) noexcept
+	{
+		uint32_t old = c.load(std::memory_order_relaxed);
+		while (n > old && !c.compare_exchange_weak(old, n, std::memory_order_relaxed)) { }
+	}
+#else
+	typedef volatile uint32_t ItemCounter;
+	inline void AddToCounter(ItemCounter& c, int32_t n) noexcept { c = c + (uint32_t)n; }
+	inline uint32_t ReadCounter(const ItemCounter& c) noexcept { return c; }
+	inline void MaxIntoCounter(ItemCounter& c, uint32_t n) noexcept { if (n > c) { c = n; } }
+#endif
 
-	template<size_t Sz> void *Freelist<Sz>::AllocateItem() noexcept
+#ifdef RTOS
+	// Return true if we are running in an ISR
+	inline bool IsInInterrupt() noexcept
+	{
+		uint32_t ipsr;
+		asm volatile("mrs %0, ipsr" : "=r" (ipsr));
+		return (ipsr & 0x1FF) != 0;
+	}
+#endif
+
+	// Type of function that the application can register to be told that memory is short. It is called with the number of bytes needed, after the free lists have been trimmed.
+	typedef void (*LowMemoryCallback)(size_t bytesNeeded) noexcept;
+
+	// Free list for items of one size. There is one of these for each size class, and each one adds itself to a list of all size classes the first time it allocates from the heap.
+	class FreelistBase
 	{
+	public:
+		explicit constexpr FreelistBase(size_t sz) noexcept
+			: freelist(nullptr), next(nullptr), slabs(nullptr), itemSize(sz), maxFree(NoLimit), registered(false)
+#ifdef FREELIST_TASK_CACHE
+			  , cacheIndex((sz != 0 && sz % 8 == 0 && sz <= FREELIST_CACHE_MAX_ITEM_SIZE) ? (uint8_t)(sz/8 - 1) : NotCached)
+#endif
+			  , freeCount(0)
+#ifdef FREELIST_STATS
+			  , allocations(0), misses(0), releases(0), peakOutstanding(0)
+#endif
+		{ }
+
+		// Allocate an item, from the free list if possible, otherwise from the heap
+		void *Allocate() noexcept;
+
+		// Return an item to the free list
+		void Release(void *p) noexcept;
+
+		// Allocate one contiguous slab of 'count' items from the heap and add them to the free list, returning false if there was not enough memory.
+		// Call this at startup for classes of object that will be allocated later, so that those objects are adjacent in memory and allocating them doesn't need to use the heap.
+		// Not safe to call from an ISR.
+		bool Reserve(size_t count) noexcept;
+
+		// Set the maximum number of items to keep in the shared free list. Beyond that, released items are returned to the heap, except when released from an ISR.
+		// Items in slabs allocated by Reserve are never returned to the heap.
+		void SetMaxFree(size_t count) noexcept { maxFree = count; }
+		size_t GetMaxFree() const noexcept { return maxFree; }
+
+		// Return the number of items in the shared free list
+		uint32_t GetFreeCount() const noexcept { return ReadCounter(freeCount); }
+
+		// Return free items from all size classes to the heap until at least targetBytes have been freed, returning the number of bytes freed.
+		// Items in the free list cache of the calling task are included, but not items in the caches of other tasks. Not safe to call from an ISR.
+		static size_t TrimAll(size_t targetBytes) noexcept;
+
+		// Set the function to call when the heap runs out of memory
+		static void SetLowMemoryCallback(LowMemoryCallback cb) noexcept { lowMemoryCallback = cb; }
+
+		static constexpr size_t NoLimit = SIZE_MAX;
+
+		size_t GetItemSize() const noexcept { return itemSize; }
+		const FreelistBase *_ecv_null GetNext() const noexcept { return next; }
+
+		// Get the list of size classes that have been used
+		static const FreelistBase *_ecv_null GetList() noexcept { return sizeClassList; }
+
+#ifdef FREELIST_STATS
+		uint32_t GetAllocations() const noexcept { return ReadCounter(allocations); }
+		uint32_t GetHits() const noexcept { return ReadCounter(allocations) - ReadCounter(misses); }
+		uint32_t GetMisses() const noexcept { return ReadCounter(misses); }
+		uint32_t GetReleases() const noexcept { return ReadCounter(releases); }
+		uint32_t GetOutstanding() const noexcept { return ReadCounter(allocations) - ReadCounter(releases); }
+		uint32_t GetPeakOutstanding() const noexcept { return ReadCounter(peakOutstanding); }
+
+		// Append a line reporting the statistics for this size class to 'reply'
+		void AppendReport(const StringRef& reply) const noexcept;
+
+		// Report the statistics for all size classes that have been used
+		static void ReportAll(const StringRef& reply) noexcept;
+#endif
+
+	private:
+#ifdef FREELIST_TASK_CACHE
+		friend class TaskCache;
+
+		static constexpr uint8_t NotCached = 0xFF;
+#endif
+
+		// Remove the first item from the free list and return it, or return nullptr if the list is empty
+		void *_ecv_null Pop() noexcept;
+
+		// Add an item to the front of the free list
+		void Push(void *p) noexcept;
+
+		// Add a chain of 'count' items linked through their first words to the front of the free list
+		void PushChain(void *first, void *last, size_t count) noexcept;
+
+#ifdef FREELIST_TASK_CACHE
+		// Remove up to maxCount items from the free list and return them linked through their first words, setting 'count' to the number removed
+		void *_ecv_null PopChain(size_t maxCount, size_t& count) noexcept;
+#endif
+
+		// Allocate an item from the heap, after adding this size class to the list if we haven't already. Not safe to call from an ISR.
+		void *AllocateFromHeap() noexcept;
+
+		// Return an item to the heap if we can, returning true if successful. Called when the shared free list is full.
+		bool ReleaseToHeap(void *p) noexcept;
+
+		// Return true if the item is part of a slab allocated by Reserve
+		bool IsInSlab(const void *p) const noexcept;
+
+		// Return free items from the shared list to the heap until at least targetBytes have been freed or the list is empty, returning the number of bytes freed
+		size_t Trim(size_t targetBytes) noexcept;
+
+		// Header of a slab allocated by Reserve. The items follow it.
+		struct Slab
 		{
-#ifdef RTOS
-			TaskCriticalSectionLocker lock;
+			Slab *_ecv_null next;
+			size_t count;
+		};
+
+		// Add this size class to the list if we haven't already
+		void Register() noexcept;
+
+#ifdef FREELIST_STATS
+		void UpdatePeakOutstanding() noexcept;
+#endif
+
+		void *_ecv_null volatile freelist;
+		FreelistBase *_ecv_null next;
+		Slab *_ecv_null slabs;
+		const size_t itemSize;
+		size_t maxFree;						// the maximum number of items to keep in the shared free list
+		bool registered;
+#ifdef FREELIST_TASK_CACHE
+		const uint8_t cacheIndex;			// which entry in the task caches holds items of this size, or NotCached
+#endif
+
+		ItemCounter freeCount;				// number of items currently in the shared free list
+#ifdef FREELIST_STATS
+		ItemCounter allocations;			// total number of items allocated
+		ItemCounter misses;					// number of allocations that fell through to the heap
+		ItemCounter releases;				// total number of items released
+		ItemCounter peakOutstanding;		// the most items that have been allocated and not released
 #endif
-			if (freelist != nullptr)
+
+		static FreelistBase *_ecv_null sizeClassList;
+		static LowMemoryCallback _ecv_null lowMemoryCallback;
+	};
+
+	inline void *_ecv_null FreelistBase::Pop() noexcept
+	{
+#ifdef FREELIST_LOCK_FREE
+		void *_ecv_null p;
+		for (;;)
+		{
+			p = LoadExclusive(&freelist);
+			if (p == nullptr)
+			{
+				ClearExclusive();
+				break;
+			}
+			// If p has been popped by someone else since we loaded it, the following load may fetch rubbish, but then the store will fail
+			if (StoreExclusive(&freelist, *reinterpret_cast<void *_ecv_null *>(p)))
 			{
-				void * const p = _ecv_not_null(freelist);
-				freelist = *reinterpret_cast<void *_ecv_null *>(p);
-				return p;
+				break;
 			}
 		}
-		return ::operator new(Sz);
+#else
+		FreelistLocker lock;
+		void *_ecv_null const p = freelist;
+		if (p != nullptr)
+		{
+			freelist = *reinterpret_cast<void *_ecv_null *>(p);
+		}
+#endif
+		if (p != nullptr)
+		{
+			AddToCounter(freeCount, -1);
+		}
+		return p;
 	}
 
-	template<size_t Sz> void Freelist<Sz>::ReleaseItem(void *p) noexcept
+	inline void FreelistBase::Push(void *p) noexcept
 	{
-#ifdef RTOS
-		TaskCriticalSectionLocker lock;
-#endif
+#ifdef FREELIST_LOCK_FREE
+		do
+		{
+			*reinterpret_cast<void *_ecv_null *>(p) = LoadExclusive(&freelist);
+		} while (!StoreExclusive(&freelist, p));
+#else
+		FreelistLocker lock;
 		*reinterpret_cast<void *_ecv_null *>(p) = freelist;
 		freelist = p;
+#endif
+		AddToCounter(freeCount, 1);
+	}
+
+#ifdef FREELIST_TASK_CACHE
+
+	// Cache of free items belonging to one task or thread. Only the owning task uses it, so it needs no locking.
+	class TaskCache
+	{
+	public:
+		// Allocate an item from the cache of the current task, refilling the cache from the shared list if necessary.
+		// Return nullptr if the caller is not a task that can have a cache, in which case the caller must use the shared list.
+		static void *_ecv_null Allocate(FreelistBase& fl) noexcept;
+
+		// Release an item to the cache of the current task, moving a batch of items to the shared list if the cache is full.
+		// Return false if the caller is not a task that can have a cache, in which case the caller must use the shared list.
+		static bool Release(FreelistBase& fl, void *p) noexcept;
+
+		// Return all the items in a cache to the shared lists, then delete the cache and set the pointer to null. The task that owned it must not be running.
+		static void Flush(TaskCache *_ecv_null& cache) noexcept;
+
+		// Flush the cache of the calling task, if it has one
+		static void FlushCurrent() noexcept;
+
+		static constexpr size_t NumEntries = FREELIST_CACHE_MAX_ITEM_SIZE/8;
+		static constexpr size_t BatchSize = FREELIST_CACHE_BATCH_SIZE;
+		static constexpr size_t MaxItemsPerEntry = 2 * BatchSize;
+
+	private:
+		TaskCache() noexcept;
+
+		// Return a reference to the cache pointer for the current task, or nullptr if we are in an ISR or the caller is not a task
+		static TaskCache *_ecv_null *_ecv_null GetCurrentCachePointer() noexcept;
+
+		// Return the cache of the current task, creating it if necessary, or nullptr
+		static TaskCache *_ecv_null GetCurrent() noexcept;
+
+		void *_ecv_null heads[NumEntries];
+		uint8_t counts[NumEntries];
+	};
+
+#endif
+
+	inline void *FreelistBase::Allocate() noexcept
+	{
+#ifdef FREELIST_STATS
+		AddToCounter(allocations, 1);
+		UpdatePeakOutstanding();
+#endif
+#ifdef FREELIST_TASK_CACHE
+		if (cacheIndex != NotCached)
+		{
+			void *_ecv_null const cp = TaskCache::Allocate(*this);
+			if (cp != nullptr)
+			{
+				return not_null(cp);
+			}
+		}
+#endif
+		void *_ecv_null const p = Pop();
+		return (p != nullptr) ? not_null(p) : AllocateFromHeap();
+	}
+
+	inline void FreelistBase::Release(void *p) noexcept
+	{
+#ifdef FREELIST_STATS
+		AddToCounter(releases, 1);
+#endif
+#ifdef FREELIST_TASK_CACHE
+		if (cacheIndex != NotCached && TaskCache::Release(*this, p))
+		{
+			return;
+		}
+#endif
+		if (ReadCounter(freeCount) < maxFree || !ReleaseToHeap(p))
+		{
+			Push(p);
+		}
 	}
 
+	// Free list manager class
+	template<size_t Sz> class Freelist
+	{
+	public:
+		static void *AllocateItem() noexcept { return sizeClass.Allocate(); }
+		static void ReleaseItem(void *p) noexcept { sizeClass.Release(p); }
+		static bool Reserve(size_t count) noexcept { return sizeClass.Reserve(count); }
+		static void SetMaxFree(size_t count) noexcept { sizeClass.SetMaxFree(count); }
+		static const FreelistBase& GetSizeClass() noexcept { return sizeClass; }
+
+	private:
+		static FreelistBase sizeClass;
+	};
+
+	template<size_t Sz> FreelistBase Freelist<Sz>::sizeClass(Sz);
+
 	// Macro to return the size of objects of a given type rounded up to a multiple of 8 bytes.
 	// We use this to reduce the number of freelists that we need to keep.
 	inline constexpr size_t RoundedUpSize(size_t rawSize) noexcept
@@ -74,6 +416,24 @@ namespace FreelistManager
 	{
 		Freelist<RoundedUpSize(sizeof(T))>::ReleaseItem(p);
 	}
+
+	// Call this at startup to reserve a contiguous slab of memory for 'count' objects of type T
+	template<class T> inline bool Reserve(size_t count) noexcept
+	{
+		return Freelist<RoundedUpSize(sizeof(T))>::Reserve(count);
+	}
+
+	// Limit the number of free objects of type T that are kept for reuse. Note that this applies to all types that have the same rounded-up size.
+	template<class T> inline void SetMaxFree(size_t count) noexcept
+	{
+		Freelist<RoundedUpSize(sizeof(T))>::SetMaxFree(count);
+	}
+
+	// Return free items to the heap until at least targetBytes have been freed, returning the number of bytes freed. Pass NoLimit to free as much as possible.
+	inline size_t Trim(size_t targetBytes) noexcept
+	{
+		return FreelistBase::TrimAll(targetBytes);
+	}
 }
 
 // Call this macro within a class public section to use freelist new and delete
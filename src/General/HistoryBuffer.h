@@ -0,0 +1,112 @@
+/*
+ * HistoryBuffer.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ *
+ *  Ring buffer that keeps the most recent N items, for capturing telemetry such as accelerometer samples, temperature history and trace events
+ */
+
+#ifndef SRC_GENERAL_HISTORYBUFFER_H_
+#define SRC_GENERAL_HISTORYBUFFER_H_
+
+#include "../ecv_duet3d.h"
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <atomic>
+
+// Unlike RingBuffer, storing an item never fails: when the buffer is full the oldest item is overwritten.
+// There is one writer, which may be a task or an ISR. Any number of readers may take snapshots concurrently without locking and without holding up the writer.
+// A snapshot copies the items and then checks which of them the writer may have overwritten in the meantime, and discards those.
+// N must be a power of 2. Items are copied with memcpy, so they must be trivially copyable.
+template<class T, size_t N> class HistoryBuffer
+{
+	static_assert(N >= 2 && (N & (N - 1)) == 0, "Number of items must be a power of 2");
+
+public:
+	HistoryBuffer() noexcept : itemsWritten(0) { }
+
+	// Store an item, overwriting the oldest one if the buffer is full
+	void PutItem(T val) noexcept;
+
+	// Copy up to maxItems of the newest items to 'buffer', oldest first, returning the number copied.
+	// If firstItemNumber is not null, set it to the number of the first item copied, where the first item ever stored is number 0. Readers can use this to detect items they have missed.
+	// Fewer than maxItems are returned if fewer have been stored, or if the writer overwrites some of the oldest ones being copied.
+	// Because the writer may be overwriting the oldest item at any time, at most N - 1 items are returned.
+	size_t Snapshot(T * _ecv_array buffer, size_t maxItems, size_t * _ecv_null firstItemNumber = nullptr) const noexcept;
+
+	// Return the number of items in the buffer
+	size_t ItemsPresent() const noexcept;
+
+	// Return the total number of items that have been stored. This wraps round when it overflows.
+	size_t ItemsWritten() const noexcept { return itemsWritten.load(std::memory_order_acquire); }
+
+	// Return the capacity
+	static constexpr size_t GetCapacity() noexcept { return N; }
+
+	// Clear the buffer. Must not be called while the buffer is being written.
+	void Clear() noexcept { itemsWritten.store(0, std::memory_order_release); }
+
+private:
+	static constexpr size_t Mask = N - 1;
+
+	T data[N];
+	std::atomic<size_t> itemsWritten;			// the number of the next item to be written
+};
+
+template<class T, size_t N> inline void HistoryBuffer<T, N>::PutItem(T val) noexcept
+{
+	const size_t itemNumber = itemsWritten.load(std::memory_order_relaxed);		// only we write this
+
+	// Make sure that a reader sees the previous update to itemsWritten before it can see the slot being overwritten
+	std::atomic_thread_fence(std::memory_order_release);
+	data[itemNumber & Mask] = val;
+	itemsWritten.store(itemNumber + 1, std::memory_order_release);
+}
+
+template<class T, size_t N> inline size_t HistoryBuffer<T, N>::ItemsPresent() const noexcept
+{
+	const size_t written = itemsWritten.load(std::memory_order_acquire);
+	return (written < N) ? written : N;
+}
+
+template<class T, size_t N> size_t HistoryBuffer<T, N>::Snapshot(T * _ecv_array buffer, size_t maxItems, size_t * _ecv_null firstItemNumber) const noexcept
+{
+	const size_t writtenBefore = itemsWritten.load(std::memory_order_acquire);
+	const size_t available = (writtenBefore < N) ? writtenBefore : N;
+	if (maxItems > available)
+	{
+		maxItems = available;
+	}
+
+	// Copy items writtenBefore - maxItems to writtenBefore - 1 in up to two blocks
+	size_t first = writtenBefore - maxItems;
+	const size_t startIndex = first & Mask;
+	const size_t toCopyFirst = (maxItems < N - startIndex) ? maxItems : N - startIndex;
+	memcpy(buffer, data + startIndex, toCopyFirst * sizeof(T));
+	memcpy(buffer + toCopyFirst, data, (maxItems - toCopyFirst) * sizeof(T));
+
+	// While we were copying, the writer may have overwritten some of the oldest items we copied.
+	// If the writer has stored up to item writtenAfter - 1, it may be in the process of writing item writtenAfter, so only items after writtenAfter - N are intact.
+	std::atomic_thread_fence(std::memory_order_acquire);
+	const size_t writtenAfter = itemsWritten.load(std::memory_order_relaxed);
+	const size_t overwritten = writtenAfter - writtenBefore;
+	const size_t numIntact = (overwritten >= N - 1) ? 0 : N - 1 - overwritten;		// the number of newest items we copied that are certainly intact
+	size_t numValid = maxItems;
+	if (numValid > numIntact)
+	{
+		const size_t numDropped = numValid - numIntact;
+		memmove(buffer, buffer + numDropped, numIntact * sizeof(T));
+		first += numDropped;
+		numValid = numIntact;
+	}
+
+	if (firstItemNumber != nullptr)
+	{
+		*firstItemNumber = first;
+	}
+	return numValid;
+}
+
+#endif /* SRC_GENERAL_HISTORYBUFFER_H_ */
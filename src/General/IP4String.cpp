@@ -6,18 +6,25 @@
  */
 
 #include "IP4String.h"
-#include "StringRef.h"
-#include "SafeVsnprintf.h"
+#include "IntegerToDecimal.h"
 
 IP4String::IP4String(const uint8_t ip[4]) noexcept
+	: IP4String((uint32_t)ip[0] | ((uint32_t)ip[1] << 8) | ((uint32_t)ip[2] << 16) | ((uint32_t)ip[3] << 24))
 {
-	SafeSnprintf(buf, sizeof(buf)/sizeof(buf[0]), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
 }
 
 IP4String::IP4String(uint32_t ip) noexcept
 {
-	SafeSnprintf(buf, sizeof(buf)/sizeof(buf[0]), "%u.%u.%u.%u",
-				(unsigned int)(ip & 0xFFu), (unsigned int)((ip >> 8) & 0xFFu), (unsigned int)((ip >> 16) & 0xFFu), (unsigned int)((ip >> 24) & 0xFFu));
+	// Format the bytes directly instead of using SafeSnprintf, which is much slower. Each byte has at most 3 digits so the buffer can't overflow.
+	char *_ecv_array p = buf;
+	for (unsigned int i = 0; i < 4; ++i)
+	{
+		if (i != 0)
+		{
+			*p++ = '.';
+		}
+		p += FormatU32(p, 4, (ip >> (8 * i)) & 0xFFu);
+	}
 }
 
 // End
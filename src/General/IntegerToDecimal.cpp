@@ -0,0 +1,137 @@
+/*
+ * IntegerToDecimal.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ */
+
+#include "IntegerToDecimal.h"
+#include <cstring>
+
+// Pairs of digits for the numbers 0 to 99, so that we need only one division per two digits
+static const char DigitPairs[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+// Return the high 64 bits of the 128-bit product of a and b using 32-bit multiplications, which Cortex-M3/M4/M7 processors do in one instruction
+static inline uint64_t MultiplyHigh64(uint64_t a, uint64_t b) noexcept
+{
+	const uint64_t aLo = (uint32_t)a, aHi = a >> 32, bLo = (uint32_t)b, bHi = b >> 32;
+	const uint64_t loLo = aLo * bLo, loHi = aLo * bHi, hiLo = aHi * bLo, hiHi = aHi * bHi;
+	const uint64_t mid = (loLo >> 32) + (uint32_t)loHi + (uint32_t)hiLo;
+	return hiHi + (loHi >> 32) + (hiLo >> 32) + (mid >> 32);
+}
+
+// Divide by 10^8 by multiplying by the reciprocal. 10^8 = 2^8 * 390625, and after removing the 2^8 the dividend has only 56 bits,
+// which lets us use a multiplier that gives exact results for every dividend.
+static inline uint64_t DivideBy1e8(uint64_t val) noexcept
+{
+	return MultiplyHigh64(val >> 8, 0x00ABCC77118461CFull) >> 10;
+}
+
+// Store exactly 8 digits of val, which must be less than 10^8
+static inline char *_ecv_array Write8DigitsBackwards(uint32_t val, char *_ecv_array end) noexcept
+{
+	for (unsigned int i = 0; i < 4; ++i)
+	{
+		const uint32_t quot = val/100;
+		end -= 2;
+		memcpy(end, DigitPairs + 2 * (val - quot * 100), 2);
+		val = quot;
+	}
+	return end;
+}
+
+char *_ecv_array WriteU32DecimalBackwards(uint32_t val, char *_ecv_array end) noexcept
+{
+	while (val >= 100)
+	{
+		const uint32_t quot = val/100;
+		end -= 2;
+		memcpy(end, DigitPairs + 2 * (val - quot * 100), 2);
+		val = quot;
+	}
+	if (val >= 10)
+	{
+		end -= 2;
+		memcpy(end, DigitPairs + 2 * val, 2);
+	}
+	else
+	{
+		*--end = (char)('0' + val);
+	}
+	return end;
+}
+
+char *_ecv_array WriteU64DecimalBackwards(uint64_t val, char *_ecv_array end) noexcept
+{
+	// Peel off 8 digits at a time until the remainder fits in 32 bits
+	while ((val >> 32) != 0)
+	{
+		const uint64_t quot = DivideBy1e8(val);
+		end = Write8DigitsBackwards((uint32_t)(val - quot * 100000000u), end);
+		val = quot;
+	}
+	return WriteU32DecimalBackwards((uint32_t)val, end);
+}
+
+// Copy the characters between start and end to the buffer with a null terminator, truncating if necessary, and return the number of characters
+static size_t CopyToBuffer(char *_ecv_array buffer, size_t bufLen, const char *_ecv_array start, const char *_ecv_array end) noexcept
+{
+	const size_t len = (size_t)(end - start);
+	if (bufLen != 0)
+	{
+		const size_t toCopy = (len < bufLen) ? len : bufLen - 1;
+		memcpy(buffer, start, toCopy);
+		buffer[toCopy] = 0;
+	}
+	return len;
+}
+
+size_t FormatU32(char *_ecv_array buffer, size_t bufLen, uint32_t val) noexcept
+{
+	char temp[MaxU32DecimalDigits];
+	char *_ecv_array const end = temp + MaxU32DecimalDigits;
+	return CopyToBuffer(buffer, bufLen, WriteU32DecimalBackwards(val, end), end);
+}
+
+size_t FormatI32(char *_ecv_array buffer, size_t bufLen, int32_t val) noexcept
+{
+	char temp[MaxU32DecimalDigits + 1];
+	char *_ecv_array const end = temp + MaxU32DecimalDigits + 1;
+	char *_ecv_array start = WriteU32DecimalBackwards((val < 0) ? 0u - (uint32_t)val : (uint32_t)val, end);
+	if (val < 0)
+	{
+		*--start = '-';
+	}
+	return CopyToBuffer(buffer, bufLen, start, end);
+}
+
+size_t FormatU64(char *_ecv_array buffer, size_t bufLen, uint64_t val) noexcept
+{
+	char temp[MaxU64DecimalDigits];
+	char *_ecv_array const end = temp + MaxU64DecimalDigits;
+	return CopyToBuffer(buffer, bufLen, WriteU64DecimalBackwards(val, end), end);
+}
+
+size_t FormatI64(char *_ecv_array buffer, size_t bufLen, int64_t val) noexcept
+{
+	char temp[MaxU64DecimalDigits + 1];
+	char *_ecv_array const end = temp + MaxU64DecimalDigits + 1;
+	char *_ecv_array start = WriteU64DecimalBackwards((val < 0) ? 0u - (uint64_t)val : (uint64_t)val, end);
+	if (val < 0)
+	{
+		*--start = '-';
+	}
+	return CopyToBuffer(buffer, bufLen, start, end);
+}
+
+// End
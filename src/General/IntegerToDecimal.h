@@ -0,0 +1,33 @@
+/*
+ * IntegerToDecimal.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ *
+ *  Fast conversion of integers to decimal, for use by the printf functions and by callers that don't need the printf machinery
+ */
+
+#ifndef SRC_GENERAL_INTEGERTODECIMAL_H_
+#define SRC_GENERAL_INTEGERTODECIMAL_H_
+
+#include "../ecv_duet3d.h"
+#include <cstdint>
+#include <cstddef>
+
+constexpr size_t MaxU32DecimalDigits = 10;			// to print 4294967295
+constexpr size_t MaxU64DecimalDigits = 20;			// to print 18446744073709551615
+
+// Store the decimal digits of val so that they end just before 'end' and return a pointer to the first one. No terminator is stored.
+// There must be room for MaxU32DecimalDigits or MaxU64DecimalDigits characters before 'end'.
+// Two digits are produced at a time using a table. The 64-bit version avoids 64-bit division, which is slow on ARM processors.
+char *_ecv_array WriteU32DecimalBackwards(uint32_t val, char *_ecv_array end) noexcept;
+char *_ecv_array WriteU64DecimalBackwards(uint64_t val, char *_ecv_array end) noexcept;
+
+// Store the decimal representation of val followed by a null terminator and return its length excluding the terminator.
+// If the buffer is too small then the output is truncated, but the return value is still the length of the complete representation.
+size_t FormatU32(char *_ecv_array buffer, size_t bufLen, uint32_t val) noexcept;
+size_t FormatI32(char *_ecv_array buffer, size_t bufLen, int32_t val) noexcept;
+size_t FormatU64(char *_ecv_array buffer, size_t bufLen, uint64_t val) noexcept;
+size_t FormatI64(char *_ecv_array buffer, size_t bufLen, int64_t val) noexcept;
+
+#endif /* SRC_GENERAL_INTEGERTODECIMAL_H_ */
@@ -0,0 +1,168 @@
+/*
+ * JsonWriter.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ */
+
+#include "JsonWriter.h"
+#include "IntegerToDecimal.h"
+#include "FloatToDecimal.h"
+#include <cstring>
+
+// Write characters unless the sink has already become full
+void JsonWriter::WriteRaw(const char *_ecv_array s, size_t len) noexcept
+{
+	if (!overflowed && !printer.PrintLiteral(s, len))
+	{
+		overflowed = true;
+	}
+}
+
+// Write a string in quotes, escaping it as the "%.s" format does
+void JsonWriter::WriteEscaped(const char *_ecv_array s) noexcept
+{
+	WriteRaw("\"", 1);
+	if (!overflowed && !printer.PrintString(FormatConversion{ 's', FormatConversion::Json, 0, -1 }, s))
+	{
+		overflowed = true;
+	}
+	WriteRaw("\"", 1);
+}
+
+// Write a comma if this isn't the first value in the current container
+void JsonWriter::BeginValue() noexcept
+{
+	if (afterKey)
+	{
+		afterKey = false;
+	}
+	else
+	{
+		if (needComma)
+		{
+			WriteRaw(",", 1);
+		}
+		needComma = true;
+	}
+}
+
+void JsonWriter::BeginContainer(char c) noexcept
+{
+	BeginValue();
+	if (depth == MaxDepth)
+	{
+		overflowed = true;
+		return;
+	}
+	WriteRaw(&c, 1);
+	commaStack = (commaStack << 1) | (uint32_t)needComma;
+	++depth;
+	needComma = false;
+}
+
+void JsonWriter::EndContainer(char c) noexcept
+{
+	if (depth != 0)
+	{
+		WriteRaw(&c, 1);
+		--depth;
+		needComma = (commaStack & 1u) != 0;
+		commaStack >>= 1;
+	}
+	afterKey = false;
+}
+
+void JsonWriter::Key(const char *_ecv_array key) noexcept
+{
+	BeginValue();
+	WriteEscaped(key);
+	WriteRaw(":", 1);
+	afterKey = true;
+}
+
+void JsonWriter::Value(const char *_ecv_array null s) noexcept
+{
+	if (s == nullptr)
+	{
+		Null();
+	}
+	else
+	{
+		BeginValue();
+		WriteEscaped(s);
+	}
+}
+
+void JsonWriter::Value(bool b) noexcept
+{
+	BeginValue();
+	if (b)
+	{
+		WriteRaw("true", 4);
+	}
+	else
+	{
+		WriteRaw("false", 5);
+	}
+}
+
+void JsonWriter::Null() noexcept
+{
+	BeginValue();
+	WriteRaw("null", 4);
+}
+
+void JsonWriter::WriteInteger(uint64_t magnitude, bool negative) noexcept
+{
+	BeginValue();
+	char buf[MaxU64DecimalDigits + 1];
+	char *_ecv_array const end = buf + sizeof(buf);
+	char *_ecv_array start = ((magnitude >> 32) == 0) ? WriteU32DecimalBackwards((uint32_t)magnitude, end) : WriteU64DecimalBackwards(magnitude, end);
+	if (negative)
+	{
+		*--start = '-';
+	}
+	WriteRaw(start, (size_t)(end - start));
+}
+
+// Return true if a float is NaN or infinity, which JSON can't represent. This avoids using floating point instructions.
+static bool IsNotFinite(float f) noexcept
+{
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return (bits & 0x7F800000u) == 0x7F800000u;
+}
+
+void JsonWriter::Value(float f) noexcept
+{
+	if (IsNotFinite(f))
+	{
+		Null();
+	}
+	else
+	{
+		BeginValue();
+		char buf[MaxShortestFloatLength];
+		const size_t len = FormatShortestFloat(buf, sizeof(buf), f);
+		WriteRaw(buf, len);
+	}
+}
+
+void JsonWriter::Value(float f, unsigned int numDecimals) noexcept
+{
+	if (IsNotFinite(f))
+	{
+		Null();
+	}
+	else
+	{
+		BeginValue();
+		if (!overflowed && !printer.PrintFloat(FormatConversion{ 'f', 0, 0, (int16_t)numDecimals }, (double)f))
+		{
+			overflowed = true;
+		}
+	}
+}
+
+// End
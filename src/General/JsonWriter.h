@@ -0,0 +1,85 @@
+/*
+ * JsonWriter.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ *
+ *  Class to write JSON to a sink without building it up from format strings
+ */
+
+#ifndef SRC_GENERAL_JSONWRITER_H_
+#define SRC_GENERAL_JSONWRITER_H_
+
+#include "../ecv_duet3d.h"
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include "SafeVsnprintf.h"
+
+// Class to write JSON objects and arrays. Commas and colons are inserted automatically, and strings are escaped in the same way as the "%.s" printf format.
+// Output goes to a PrintSink, so it can be written to a StringRef using a StringRefSink or sent in chunks by a sink that transmits data as its buffer fills.
+// If the sink becomes full then nothing more is written and HasOverflowed returns true. Nesting deeper than MaxDepth also sets the overflow flag.
+// Example: writer.BeginObject(); writer.Property("status", "idle"); writer.Key("pos"); writer.BeginArray(); writer.Value(x); writer.Value(y); writer.EndArray(); writer.EndObject();
+class JsonWriter
+{
+public:
+	static constexpr unsigned int MaxDepth = 32;
+
+	explicit JsonWriter(PrintSink& s) noexcept : printer(s), commaStack(0), depth(0), needComma(false), afterKey(false), overflowed(false) { }
+
+	void BeginObject() noexcept { BeginContainer('{'); }
+	void EndObject() noexcept { EndContainer('}'); }
+	void BeginArray() noexcept { BeginContainer('['); }
+	void EndArray() noexcept { EndContainer(']'); }
+
+	// Write the key of the next member of an object
+	void Key(const char *_ecv_array key) noexcept;
+
+	// Write a value. A null string pointer is written as null.
+	void Value(const char *_ecv_array null s) noexcept;
+	void Value(bool b) noexcept;
+	template<class T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0> void Value(T val) noexcept;
+
+	// Write a float using the shortest representation that reads back as the same value, or with a fixed number of decimal places. NaN and infinity are written as null.
+	void Value(float f) noexcept;
+	void Value(float f, unsigned int numDecimals) noexcept;
+	void Value(double d) noexcept = delete;								// convert to float explicitly, or call Value(float, unsigned int)
+
+	void Null() noexcept;
+
+	// Write a key and a value
+	template<class T> void Property(const char *_ecv_array key, T val) noexcept { Key(key); Value(val); }
+
+	// Return the number of characters written so far, and whether anything was lost because the sink became full
+	int GetLength() const noexcept { return printer.GetLength(); }
+	bool HasOverflowed() const noexcept { return overflowed; }
+
+private:
+	void BeginValue() noexcept;
+	void BeginContainer(char c) noexcept;
+	void EndContainer(char c) noexcept;
+	void WriteInteger(uint64_t magnitude, bool negative) noexcept;
+	void WriteRaw(const char *_ecv_array s, size_t len) noexcept;
+	void WriteEscaped(const char *_ecv_array s) noexcept;
+
+	ConversionPrinter printer;
+	uint32_t commaStack;												// the values of needComma in the enclosing containers
+	unsigned int depth;
+	bool needComma;														// true if a comma is needed before the next value in the current container
+	bool afterKey;														// true if we have written a key and the next value belongs to it
+	bool overflowed;
+};
+
+template<class T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type> void JsonWriter::Value(T val) noexcept
+{
+	if constexpr (std::is_signed<T>::value)
+	{
+		WriteInteger((val < 0) ? 0u - (uint64_t)val : (uint64_t)val, val < 0);
+	}
+	else
+	{
+		WriteInteger((uint64_t)val, false);
+	}
+}
+
+#endif /* SRC_GENERAL_JSONWRITER_H_ */
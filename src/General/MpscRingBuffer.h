@@ -0,0 +1,194 @@
+/*
+ * MpscRingBuffer.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ *
+ *  Bounded ring buffer of variable-length byte records that may be written by multiple producers (tasks or ISRs) concurrently and read by one consumer.
+ *  Based on the bounded MPMC queue by Dmitry Vyukov: each slot has a sequence number that tells producers and the consumer whether it is free, claimed or filled.
+ */
+
+#ifndef SRC_GENERAL_MPSCRINGBUFFER_H_
+#define SRC_GENERAL_MPSCRINGBUFFER_H_
+
+#include "../ecv_duet3d.h"
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <atomic>
+#include "Portability.h"
+
+// The storage is divided into NumSlots slots of SlotSize bytes each. A record occupies one or more consecutive slots, so its data is always contiguous.
+// A producer claims all the slots for a record with a single compare-and-swap, so records from different producers never interleave.
+// If a record would wrap round the end of the storage, the producer claims the slots up to the end as well and marks them as padding, which the consumer skips.
+// There are no locks, so Reserve, Commit and Put may be called from ISRs. On ARMv6-M processors the compare-and-swap is provided by the runtime library.
+// Records that have been reserved but not yet committed hold up the consumer, so keep the time between Reserve and Commit short.
+template<size_t NumSlots, size_t SlotSize = 16> class MpscRingBuffer
+{
+	static_assert(NumSlots >= 2 && (NumSlots & (NumSlots - 1)) == 0, "Number of slots must be a power of 2");
+	static_assert(NumSlots * SlotSize < 0xFFFF, "Buffer too large for 16-bit record lengths");
+
+public:
+	// Space reserved for a record by Reserve. The record is invisible to the consumer until Commit is called.
+	struct Reservation
+	{
+		uint8_t * _ecv_array _ecv_null data;		// where to store the record, or nullptr if there was no room
+		size_t position;							// the position of the first slot of the record
+		size_t length;								// the length of the record in bytes
+
+		bool IsValid() const noexcept { return data != nullptr; }
+	};
+
+	MpscRingBuffer() noexcept;
+
+	// Reserve space for a record of 'length' bytes. Check IsValid() on the result, because this fails if there is not enough free space.
+	Reservation Reserve(size_t length) noexcept;
+
+	// Make a record that was reserved and then filled in available to the consumer
+	void Commit(const Reservation& r) noexcept;
+
+	// Store a complete record returning true if successful
+	bool Put(const uint8_t * _ecv_array record, size_t length) noexcept;
+
+	// Consumer functions. Only one task may call these.
+	// Return a pointer to the oldest record and set 'length' to its length, or return nullptr if no committed record is available
+	const uint8_t * _ecv_array _ecv_null Peek(size_t& length) noexcept;
+
+	// Remove the record returned by the last successful call to Peek
+	void Pop() noexcept;
+
+	// Return the maximum length of a record. A record never wraps round the end of the storage, so a record of more than half the slots would only fit at some positions.
+	// Longer records are always rejected, so that whether a record can be stored never depends on where the previous ones ended.
+	static constexpr size_t MaxRecordLength() noexcept { return (NumSlots/2) * SlotSize; }
+
+private:
+	static constexpr size_t Mask = NumSlots - 1;
+	static constexpr uint16_t PaddingMarker = 0xFFFF;
+
+	static constexpr size_t SlotsNeeded(size_t length) noexcept { return (length == 0) ? 1 : (length + SlotSize - 1)/SlotSize; }
+
+	// Mark 'count' slots starting at 'position' as filled. The first slot is done last, because the consumer only checks that one.
+	void Publish(size_t position, size_t count) noexcept;
+
+	alignas(CacheLineSize) std::atomic<size_t> sequences[NumSlots];	// position + 0 if the slot is free, position + 1 if it is filled
+	uint16_t lengths[NumSlots];										// the length of the record starting at each slot, or PaddingMarker
+	alignas(4) uint8_t data[NumSlots * SlotSize];
+
+	alignas(CacheLineSize) std::atomic<size_t> enqueuePosition;		// written by producers
+	alignas(CacheLineSize) size_t dequeuePosition;					// written only by the consumer
+};
+
+template<size_t NumSlots, size_t SlotSize> MpscRingBuffer<NumSlots, SlotSize>::MpscRingBuffer() noexcept
+	: enqueuePosition(0), dequeuePosition(0)
+{
+	for (size_t i = 0; i < NumSlots; ++i)
+	{
+		sequences[i].store(i, std::memory_order_relaxed);
+	}
+}
+
+template<size_t NumSlots, size_t SlotSize> typename MpscRingBuffer<NumSlots, SlotSize>::Reservation MpscRingBuffer<NumSlots, SlotSize>::Reserve(size_t length) noexcept
+{
+	const size_t slotsWanted = SlotsNeeded(length);
+	if (length <= MaxRecordLength())
+	{
+		size_t position = enqueuePosition.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			// If the record would wrap round the end of the storage, claim the slots up to the end as padding.
+			// The record uses at most half the slots, so the padding and the record always fit in an empty buffer.
+			const size_t index = position & Mask;
+			const size_t padding = (index + slotsWanted > NumSlots) ? NumSlots - index : 0;
+			const size_t lastPosition = position + padding + slotsWanted - 1;
+
+			// The consumer frees slots in order, so if the last slot we need is free then so are the others
+			const intptr_t diff = (intptr_t)(sequences[lastPosition & Mask].load(std::memory_order_acquire) - lastPosition);
+			if (diff == 0)
+			{
+				if (enqueuePosition.compare_exchange_weak(position, lastPosition + 1, std::memory_order_relaxed))
+				{
+					if (padding != 0)
+					{
+						lengths[index] = PaddingMarker;
+						Publish(position, padding);
+						position += padding;
+					}
+					return Reservation{ data + (position & Mask) * SlotSize, position, length };
+				}
+				// else compare_exchange_weak has updated 'position', so try again
+			}
+			else if (diff < 0)
+			{
+				break;						// not enough free space
+			}
+			else
+			{
+				position = enqueuePosition.load(std::memory_order_relaxed);		// another producer claimed the slots first
+			}
+		}
+	}
+	return Reservation{ nullptr, 0, 0 };
+}
+
+template<size_t NumSlots, size_t SlotSize> void MpscRingBuffer<NumSlots, SlotSize>::Publish(size_t position, size_t count) noexcept
+{
+	while (count > 1)
+	{
+		--count;
+		sequences[(position + count) & Mask].store(position + count + 1, std::memory_order_release);
+	}
+	sequences[position & Mask].store(position + 1, std::memory_order_release);
+}
+
+template<size_t NumSlots, size_t SlotSize> void MpscRingBuffer<NumSlots, SlotSize>::Commit(const Reservation& r) noexcept
+{
+	lengths[r.position & Mask] = (uint16_t)r.length;
+	Publish(r.position, SlotsNeeded(r.length));
+}
+
+template<size_t NumSlots, size_t SlotSize> bool MpscRingBuffer<NumSlots, SlotSize>::Put(const uint8_t * _ecv_array record, size_t length) noexcept
+{
+	const Reservation r = Reserve(length);
+	if (r.IsValid())
+	{
+		memcpy(r.data, record, length);
+		Commit(r);
+		return true;
+	}
+	return false;
+}
+
+template<size_t NumSlots, size_t SlotSize> const uint8_t * _ecv_array _ecv_null MpscRingBuffer<NumSlots, SlotSize>::Peek(size_t& length) noexcept
+{
+	for (;;)
+	{
+		const size_t index = dequeuePosition & Mask;
+		if (sequences[index].load(std::memory_order_acquire) != dequeuePosition + 1)
+		{
+			return nullptr;					// empty, or the oldest record has not been committed yet
+		}
+		if (lengths[index] != PaddingMarker)
+		{
+			length = lengths[index];
+			return data + index * SlotSize;
+		}
+
+		// Skip the padding at the end of the storage
+		for (size_t i = index; i < NumSlots; ++i)
+		{
+			sequences[i].store(dequeuePosition + NumSlots, std::memory_order_release);
+			++dequeuePosition;
+		}
+	}
+}
+
+template<size_t NumSlots, size_t SlotSize> void MpscRingBuffer<NumSlots, SlotSize>::Pop() noexcept
+{
+	for (size_t count = SlotsNeeded(lengths[dequeuePosition & Mask]); count != 0; --count)
+	{
+		sequences[dequeuePosition & Mask].store(dequeuePosition + NumSlots, std::memory_order_release);
+		++dequeuePosition;
+	}
+}
+
+#endif /* SRC_GENERAL_MPSCRINGBUFFER_H_ */
@@ -0,0 +1,194 @@
+/*
+ * ObjectPool.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ *
+ *  Fixed-size pool of objects of one type in static storage, identified by compact 16-bit handles
+ */
+
+#ifndef SRC_GENERAL_OBJECTPOOL_H_
+#define SRC_GENERAL_OBJECTPOOL_H_
+
+#include "../ecv_duet3d.h"
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include "Bitmap.h"
+#ifdef RTOS
+# include "../RTOSIface/RTOSIface.h"
+#endif
+
+// Use this instead of FreelistManager for classes with a fixed maximum population, so that they never use the heap.
+// Create and Destroy take O(1) time. They suspend task scheduling briefly when running under an RTOS, so they must not be used from ISRs.
+// A handle holds the slot number and a generation count that is incremented each time the slot is reused, so that a stale handle to a destroyed object is detected.
+// The number of generation bits is whatever is left over in the 16 bits after the slot number, so it is small when N is large.
+template<class T, size_t N> class ObjectPool
+{
+	static_assert(N >= 1 && N < 0xFFFF, "Pool size must be between 1 and 65534");
+
+public:
+	class Handle
+	{
+	public:
+		constexpr Handle() noexcept : value(0) { }
+
+		bool IsNull() const noexcept { return value == 0; }
+		bool operator==(Handle other) const noexcept { return value == other.value; }
+		bool operator!=(Handle other) const noexcept { return value != other.value; }
+
+		// Convert to and from the raw value, e.g. to store the handle in a message
+		uint16_t GetRaw() const noexcept { return value; }
+		static Handle FromRaw(uint16_t v) noexcept { return Handle(v); }
+
+	private:
+		friend class ObjectPool;
+
+		explicit constexpr Handle(uint16_t v) noexcept : value(v) { }
+
+		uint16_t value;					// zero for a null handle, else the slot number + 1 in the low bits and the generation in the high bits
+	};
+
+	ObjectPool() noexcept;
+	~ObjectPool() noexcept;
+
+	// Construct a new object from the arguments and return a handle to it, or a null handle if the pool is full
+	template<class... Args> Handle Create(Args&&... args) noexcept;
+
+	// Destroy an object. Does nothing if the handle is null or stale.
+	void Destroy(Handle h) noexcept;
+
+	// Destroy an object given a pointer to it, which must have been returned by Get
+	void Destroy(T *p) noexcept { Destroy(GetHandle(p)); }
+
+	// Return a pointer to an object, or nullptr if the handle is null or stale
+	T *_ecv_null Get(Handle h) noexcept;
+	const T *_ecv_null Get(Handle h) const noexcept;
+
+	// Return the handle of an object given a pointer to it
+	Handle GetHandle(const T *p) const noexcept;
+
+	// Call 'func' for each live object in slot order while it returns true. Return true if we reached the end.
+	// Must not be called while another task may be creating or destroying objects in the pool. The function may destroy the object it is passed.
+	bool IterateWhile(function_ref_noexcept<bool(T&) noexcept> func) noexcept;
+
+	size_t NumLive() const noexcept { return N - numFree; }
+	size_t NumFree() const noexcept { return numFree; }
+	static constexpr size_t Capacity() noexcept { return N; }
+
+	ObjectPool(const ObjectPool&) = delete;
+	ObjectPool& operator=(const ObjectPool&) = delete;
+
+private:
+	static constexpr unsigned int SlotBits(size_t n) noexcept { return (n == 0) ? 0 : 1 + SlotBits(n >> 1); }
+	static constexpr unsigned int IndexBits = SlotBits(N);				// number of bits needed to hold the slot number + 1
+	static constexpr uint16_t IndexMask = (uint16_t)((1u << IndexBits) - 1);
+	static constexpr uint16_t GenerationIncrement = (uint16_t)(1u << IndexBits);	// zero if there are no generation bits
+
+	T *GetSlot(size_t slot) noexcept { return std::launder(reinterpret_cast<T *>(storage[slot])); }
+	const T *GetSlot(size_t slot) const noexcept { return std::launder(reinterpret_cast<const T *>(storage[slot])); }
+
+	// Return the slot number for a handle, or N if the handle is null or stale
+	size_t GetSlotNumber(Handle h) const noexcept;
+
+	alignas(T) uint8_t storage[N][sizeof(T)];
+	uint16_t generations[N];			// the generation of each slot, already shifted left by IndexBits
+	uint16_t freeSlots[N];				// stack of free slot numbers
+	size_t numFree;
+	LargeBitmap<N> live;				// which slots hold objects
+};
+
+template<class T, size_t N> ObjectPool<T, N>::ObjectPool() noexcept : numFree(N)
+{
+	// Stack the free slots so that the lowest ones are used first
+	for (size_t i = 0; i < N; ++i)
+	{
+		generations[i] = 0;
+		freeSlots[i] = (uint16_t)(N - 1 - i);
+	}
+}
+
+template<class T, size_t N> ObjectPool<T, N>::~ObjectPool() noexcept
+{
+	(void)IterateWhile([this](T& obj) noexcept -> bool { Destroy(&obj); return true; });
+}
+
+template<class T, size_t N> template<class... Args> typename ObjectPool<T, N>::Handle ObjectPool<T, N>::Create(Args&&... args) noexcept
+{
+	size_t slot;
+	{
+#ifdef RTOS
+		TaskCriticalSectionLocker lock;
+#endif
+		if (numFree == 0)
+		{
+			return Handle();
+		}
+		--numFree;
+		slot = freeSlots[numFree];
+	}
+
+	new (storage[slot]) T(std::forward<Args>(args)...);
+	{
+		// Other slots may share this word of the bitmap, so update it under the lock
+#ifdef RTOS
+		TaskCriticalSectionLocker lock;
+#endif
+		live.SetBit(slot);
+	}
+	return Handle((uint16_t)(generations[slot] | (slot + 1)));
+}
+
+template<class T, size_t N> size_t ObjectPool<T, N>::GetSlotNumber(Handle h) const noexcept
+{
+	const size_t slot = (size_t)(h.value & IndexMask) - 1;				// this wraps round to a large number if the handle is null
+	return (slot < N && (uint16_t)(h.value & ~IndexMask) == generations[slot] && live.IsBitSet(slot)) ? slot : N;
+}
+
+template<class T, size_t N> void ObjectPool<T, N>::Destroy(Handle h) noexcept
+{
+	const size_t slot = GetSlotNumber(h);
+	if (slot < N)
+	{
+		{
+#ifdef RTOS
+			TaskCriticalSectionLocker lock;
+#endif
+			live.ClearBit(slot);
+		}
+		GetSlot(slot)->~T();
+		generations[slot] += GenerationIncrement;						// this overflows harmlessly into nothing when we run out of generation bits
+
+#ifdef RTOS
+		TaskCriticalSectionLocker lock;
+#endif
+		freeSlots[numFree] = (uint16_t)slot;
+		++numFree;
+	}
+}
+
+template<class T, size_t N> T *_ecv_null ObjectPool<T, N>::Get(Handle h) noexcept
+{
+	const size_t slot = GetSlotNumber(h);
+	return (slot < N) ? GetSlot(slot) : nullptr;
+}
+
+template<class T, size_t N> const T *_ecv_null ObjectPool<T, N>::Get(Handle h) const noexcept
+{
+	const size_t slot = GetSlotNumber(h);
+	return (slot < N) ? GetSlot(slot) : nullptr;
+}
+
+template<class T, size_t N> typename ObjectPool<T, N>::Handle ObjectPool<T, N>::GetHandle(const T *p) const noexcept
+{
+	const size_t slot = (size_t)(reinterpret_cast<const uint8_t *>(p) - storage[0])/sizeof(T);
+	return (slot < N && live.IsBitSet(slot)) ? Handle((uint16_t)(generations[slot] | (slot + 1))) : Handle();
+}
+
+template<class T, size_t N> bool ObjectPool<T, N>::IterateWhile(function_ref_noexcept<bool(T&) noexcept> func) noexcept
+{
+	return live.IterateWhile([this, func](unsigned int slot) noexcept -> bool { return func(*GetSlot(slot)); });
+}
+
+#endif /* SRC_GENERAL_OBJECTPOOL_H_ */
@@ -15,6 +15,16 @@
 
 typedef __fp16 float16_t;			///< A 16-bit floating point type
 
+// Size of a data cache line. Variables that are written by different tasks, cores or ISRs should be separated by this much to avoid false sharing.
+// Processors that have no data cache only need natural alignment.
+#if (defined(SAME70) && SAME70) || defined(__SAME70Q21__) || defined(__SAME70Q20B__) || defined(__SAME70Q21B__)
+constexpr size_t CacheLineSize = 32;
+#elif defined(__arm__)
+constexpr size_t CacheLineSize = alignof(size_t);
+#else
+constexpr size_t CacheLineSize = 64;	// typical value for host processors
+#endif
+
 // ARM Cortex M0 doesn't support unaligned memory accesses, neither does SAME70 when accessing non-cached memory
 
 static inline void copy4bytes(const void *s, void *d) noexcept
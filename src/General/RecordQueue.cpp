@@ -0,0 +1,104 @@
+/*
+ * RecordQueue.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ */
+
+#include "RecordQueue.h"
+
+// Return the longest record that can always be stored once the queue is empty, wherever the indices are
+size_t RecordQueue::MaxRecordLength() const noexcept
+{
+	// With the indices at index N/2 of N bytes of storage, a record that doesn't fit in the N/2 bytes before the end must be padded past them,
+	// and then only N/2 - 1 bytes are free at the start. Wherever the indices are, there is room for a stored size of N/2 one way or the other.
+	const size_t maxStored = (buffer.GetCapacity() + 1u)/2;
+	return (maxStored < sizeof(LengthType)) ? 0
+			: (maxStored < StoredSize(PaddingMarker - 1u)) ? maxStored - sizeof(LengthType)
+				: PaddingMarker - 1u;
+}
+
+// Get space in which to build a record of up to maxLength bytes, returning nullptr if there isn't enough room
+uint8_t *_ecv_array _ecv_null RecordQueue::ReserveRecord(size_t maxLength) noexcept
+{
+	if (maxLength >= PaddingMarker)
+	{
+		return nullptr;
+	}
+
+	const size_t needed = StoredSize(maxLength);
+	RingBufferSpan<uint8_t> span = buffer.ReserveWrite(needed);
+	if (span.length < needed)
+	{
+		// If the contiguous space is limited by the end of the storage and there is room for the record at the start, pad out the rest of the storage
+		if (span.length == 0 || buffer.SpaceLeft() < span.length + needed)
+		{
+			return nullptr;
+		}
+		const LengthType marker = PaddingMarker;
+		memcpy(span.ptr, &marker, sizeof(marker));
+		buffer.CommitWrite(span.length);
+		span = buffer.ReserveWrite(needed);
+		if (span.length < needed)
+		{
+			return nullptr;
+		}
+	}
+	return span.ptr + sizeof(LengthType);
+}
+
+// Make the record built in the space returned by ReserveRecord available to the getter
+void RecordQueue::CommitRecord(size_t length) noexcept
+{
+	RingBufferSpan<uint8_t> span = buffer.ReserveWrite(StoredSize(length));	// this returns the same space as the call to ReserveRecord did
+	const LengthType storedLength = (LengthType)length;
+	memcpy(span.ptr, &storedLength, sizeof(storedLength));
+	buffer.CommitWrite(StoredSize(length));
+}
+
+// Store a record returning true if successful
+bool RecordQueue::PutRecord(const uint8_t *_ecv_array data, size_t length) noexcept
+{
+	uint8_t *_ecv_array _ecv_null const p = ReserveRecord(length);
+	if (p == nullptr)
+	{
+		return false;
+	}
+	memcpy(p, data, length);
+	CommitRecord(length);
+	return true;
+}
+
+// Get a pointer to the oldest record and set 'length' to its length, or return nullptr if there are no records
+const uint8_t *_ecv_array _ecv_null RecordQueue::PeekRecord(size_t& length) noexcept
+{
+	for (;;)
+	{
+		const RingBufferReadSpans<uint8_t> spans = buffer.PeekRead();
+		if (spans.first.length < sizeof(LengthType))
+		{
+			return nullptr;
+		}
+
+		LengthType storedLength;
+		memcpy(&storedLength, spans.first.ptr, sizeof(storedLength));
+		if (storedLength != PaddingMarker)
+		{
+			currentRecordSize = StoredSize(storedLength);
+			length = storedLength;
+			return spans.first.ptr + sizeof(LengthType);
+		}
+
+		// The padding runs to the end of the storage, which is where the first span ends
+		buffer.Consume(spans.first.length);
+	}
+}
+
+// Remove the record returned by the last successful call to PeekRecord
+void RecordQueue::PopRecord() noexcept
+{
+	buffer.Consume(currentRecordSize);
+	currentRecordSize = 0;
+}
+
+// End
@@ -0,0 +1,62 @@
+/*
+ * RecordQueue.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ *
+ *  Queue of variable-length records such as CAN frames, reply lines or GCode lines, stored in a RingBuffer
+ */
+
+#ifndef SRC_GENERAL_RECORDQUEUE_H_
+#define SRC_GENERAL_RECORDQUEUE_H_
+
+#include "RingBuffer.h"
+
+// Each record is stored as a 16-bit length followed by the data, padded to a multiple of 2 bytes so that the length never straddles the end of the storage.
+// A record is never split across the end of the storage. If there isn't room for it before the end, the putter fills the rest of the storage with a padding record that the getter skips.
+// So the getter always sees a whole record in contiguous memory and doesn't need to scan for delimiters.
+// The usual RingBuffer rules apply: max one putter and one getter, which may be in different tasks or ISRs.
+class RecordQueue
+{
+public:
+	RecordQueue() noexcept : currentRecordSize(0) { }
+
+	// Initialise and allocate the storage. numBytes must be a power of 2.
+	void Init(size_t numBytes) noexcept { buffer.Init(numBytes); }
+
+	// Store a record returning true if successful
+	bool PutRecord(const uint8_t *_ecv_array data, size_t length) noexcept;
+
+	// Get space in which to build a record of up to maxLength bytes, returning nullptr if there isn't enough room. Call CommitRecord when it is complete.
+	uint8_t *_ecv_array _ecv_null ReserveRecord(size_t maxLength) noexcept;
+
+	// Make the record built in the space returned by ReserveRecord available to the getter. 'length' must not exceed the maxLength passed to ReserveRecord.
+	void CommitRecord(size_t length) noexcept;
+
+	// Get a pointer to the oldest record and set 'length' to its length, or return nullptr if there are no records
+	const uint8_t *_ecv_array _ecv_null PeekRecord(size_t& length) noexcept;
+
+	// Remove the record returned by the last successful call to PeekRecord
+	void PopRecord() noexcept;
+
+	// Return true if there are no records
+	bool IsEmpty() const noexcept { return buffer.IsEmpty(); }
+
+	// Return the longest record that can always be stored once the queue is empty. Records up to about twice as long fit only when the indices are near the start of the storage.
+	size_t MaxRecordLength() const noexcept;
+
+	// Clear the queue. Must not be called while the queue is being accessed by a putter or getter.
+	void Clear() noexcept { buffer.Clear(); currentRecordSize = 0; }
+
+private:
+	typedef uint16_t LengthType;
+	static constexpr LengthType PaddingMarker = 0xFFFF;
+
+	// Return the total storage used by a record of the specified length, including its length field and padding
+	static constexpr size_t StoredSize(size_t length) noexcept { return (sizeof(LengthType) + length + 1u) & ~(size_t)1u; }
+
+	RingBuffer<uint8_t> buffer;
+	size_t currentRecordSize;					// the stored size of the record returned by PeekRecord, written only by the getter
+};
+
+#endif /* SRC_GENERAL_RECORDQUEUE_H_ */
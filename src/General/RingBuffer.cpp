@@ -0,0 +1,90 @@
+/*
+ * RingBuffer.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ */
+
+#include "RingBuffer.h"
+#include <cinttypes>
+
+#ifdef RTOS
+# include "../RTOSIface/RTOSIface.h"
+#endif
+
+#ifdef RING_BUFFER_STATS
+
+RingBufferStats *_ecv_null RingBufferStats::list = nullptr;
+RingBufferStats::ClockFunction RingBufferStats::clock = nullptr;
+
+RingBufferStats::RingBufferStats() noexcept
+	: next(nullptr), name(nullptr), samplePending(false)
+{
+	Reset();
+}
+
+RingBufferStats::~RingBufferStats() noexcept
+{
+	// Unlink this buffer from the list, if it is in it
+#ifdef RTOS
+	TaskCriticalSectionLocker lock;
+#endif
+	for (RingBufferStats *_ecv_null * rpp = &list; *rpp != nullptr; rpp = &(*rpp)->next)
+	{
+		if (*rpp == this)
+		{
+			*rpp = next;
+			break;
+		}
+	}
+}
+
+// Add this buffer to the list of buffers to report
+void RingBufferStats::Register(const char *_ecv_array p_name) noexcept
+{
+#ifdef RTOS
+	TaskCriticalSectionLocker lock;
+#endif
+	if (name == nullptr)
+	{
+		next = list;
+		list = this;
+	}
+	name = p_name;
+}
+
+// Clear the statistics. Must not be called while the buffer is in use.
+void RingBufferStats::Reset() noexcept
+{
+	itemsPut = itemsGot = 0;
+	peakItems = 0;
+	rejectedPutItems = shortPutBlocks = 0;
+	residenceSamples = maxResidenceTime = 0;
+	totalResidenceTime = 0;
+	sampledItemNumber = sampleStartTime = 0;
+	samplePending.store(false, std::memory_order_relaxed);
+}
+
+// Append a line reporting these statistics to 'reply'
+void RingBufferStats::AppendReport(const StringRef& reply) const noexcept
+{
+	reply.lcatf("%s: put %" PRIu32 " got %" PRIu32 " peak %" PRIu32 " rejected %" PRIu32 " short blocks %" PRIu32,
+					(name == nullptr) ? "unnamed" : name, itemsPut, itemsGot, peakItems, rejectedPutItems, shortPutBlocks);
+	if (residenceSamples != 0)
+	{
+		reply.catf(" residence max %" PRIu32 " avg %" PRIu32, maxResidenceTime, (uint32_t)(totalResidenceTime/residenceSamples));
+	}
+}
+
+// Report the statistics of all registered buffers
+void RingBufferStats::ReportAll(const StringRef& reply) noexcept
+{
+	for (const RingBufferStats *_ecv_null rb = list; rb != nullptr; rb = rb->next)
+	{
+		rb->AppendReport(reply);
+	}
+}
+
+#endif
+
+// End
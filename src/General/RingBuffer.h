@@ -13,18 +13,183 @@
 #include <cstddef>
 #include <cstring>
 #include <utility>
+#include <atomic>
+#include "Portability.h"
 
-// Ring buffer template, used for serial I/O
+// Contiguous region of a ring buffer's storage, returned by the zero-copy access functions
+template<class T> struct RingBufferSpan
+{
+	T * _ecv_array _ecv_null ptr;
+	size_t length;
+};
+
+// Up to two contiguous regions of a ring buffer's storage, returned by PeekRead. 'second' is only non-empty when the data wraps round the end of the storage.
+template<class T> struct RingBufferReadSpans
+{
+	RingBufferSpan<T> first;
+	RingBufferSpan<T> second;
+
+	size_t TotalLength() const noexcept { return first.length + second.length; }
+};
+
+// Storage for RingBuffer. The storage is allocated from the heap by Init, so the capacity is a variable.
+template<class T> class RingBufferHeapStorage
+{
+protected:
+	RingBufferHeapStorage() noexcept : capacity(0), data(nullptr) { }
+
+	size_t Capacity() const noexcept { return capacity; }
+	T * _ecv_array Data() const noexcept { return not_null(data); }
+
+	size_t capacity;								// must be one less than a power of 2
+	T * _ecv_array _ecv_null data;
+};
+
+// Storage for StaticRingBuffer. The storage is inline and the capacity is a compile-time constant, so index wrapping doesn't need to load it.
+template<class T, size_t N> class RingBufferInlineStorage
+{
+	static_assert(N >= 2 && (N & (N - 1)) == 0, "Number of slots must be a power of 2");
+
+protected:
+	static constexpr size_t Capacity() noexcept { return N - 1; }
+	T * _ecv_array Data() noexcept { return data; }
+
+	T data[N];
+};
+
+#ifdef RING_BUFFER_STATS
+
+# include "StringRef.h"
+
+// Occupancy statistics for a ring buffer. These are only collected when RING_BUFFER_STATS is defined, so they cost nothing otherwise.
+// The putter updates the put statistics and the getter updates the get statistics, so no locking is needed.
+// Buffers that have been given a name by calling RegisterStats are linked into a list, so that the statistics for all of them can be reported together.
+class RingBufferStats
+{
+public:
+	typedef uint32_t (*ClockFunction)() noexcept;
+
+	RingBufferStats() noexcept;
+	~RingBufferStats() noexcept;
+
+	// The list holds pointers to registered objects, so they can't be copied or moved
+	RingBufferStats(const RingBufferStats&) = delete;
+	RingBufferStats& operator=(const RingBufferStats&) = delete;
+
+	// Record that numStored items were stored, after a request to store numWanted items. itemsPresent is the number present afterwards.
+	void NotePut(size_t numStored, size_t numWanted, size_t itemsPresent, bool isBlock) noexcept;
+
+	// Record that numFetched items were fetched
+	void NoteGet(size_t numFetched) noexcept;
+
+	// Add this buffer to the list of buffers to report. 'name' must be in global storage because we store a pointer to it. The destructor removes it from the list.
+	void Register(const char *_ecv_array p_name) noexcept;
+
+	// Clear the statistics. Must not be called while the buffer is in use.
+	void Reset() noexcept;
+
+	// Append a line reporting these statistics to 'reply'
+	void AppendReport(const StringRef& reply) const noexcept;
+
+	const RingBufferStats *_ecv_null GetNext() const noexcept { return next; }
+	const char *_ecv_array _ecv_null GetName() const noexcept { return name; }
+
+	// Set the function used to time how long sampled items stay in the buffer, e.g. a function that returns a hardware timer count. Until this is called, residence times are not measured.
+	static void SetClock(ClockFunction f) noexcept { clock = f; }
+
+	// Report the statistics of all registered buffers
+	static void ReportAll(const StringRef& reply) noexcept;
+
+	static const RingBufferStats *_ecv_null GetList() noexcept { return list; }
+
+	static constexpr uint32_t ResidenceSampleInterval = 64;		// measure the residence time of one item in this many
+
+	uint32_t itemsPut;							// total number of items stored
+	uint32_t itemsGot;							// total number of items fetched
+	uint32_t peakItems;							// the most items ever present
+	uint32_t rejectedPutItems;					// the number of calls to PutItem that failed because the buffer was full
+	uint32_t shortPutBlocks;					// the number of calls to PutBlock that stored fewer items than requested
+	uint32_t residenceSamples;					// the number of items whose residence time has been measured
+	uint32_t maxResidenceTime;					// the longest residence time measured, in clock ticks
+	uint64_t totalResidenceTime;				// the sum of the residence times measured, in clock ticks
+
+private:
+	RingBufferStats *_ecv_null next;
+	const char *_ecv_array _ecv_null name;
+	uint32_t sampledItemNumber;					// the value of itemsPut after the sampled item was stored
+	uint32_t sampleStartTime;
+	std::atomic<bool> samplePending;
+
+	static RingBufferStats *_ecv_null list;
+	static ClockFunction clock;
+};
+
+inline void RingBufferStats::NotePut(size_t numStored, size_t numWanted, size_t itemsPresent, bool isBlock) noexcept
+{
+	if (numStored < numWanted)
+	{
+		if (isBlock)
+		{
+			++shortPutBlocks;
+		}
+		else
+		{
+			++rejectedPutItems;
+		}
+	}
+
+	if (numStored != 0)
+	{
+		const uint32_t oldItemsPut = itemsPut;
+		itemsPut = oldItemsPut + numStored;
+		if (itemsPresent > peakItems)
+		{
+			peakItems = itemsPresent;
+		}
+
+		// If we have passed a multiple of the sample interval and the previous sample has been collected, start timing the last item we stored
+		if (clock != nullptr && (oldItemsPut ^ itemsPut) >= ResidenceSampleInterval && !samplePending.load(std::memory_order_acquire))
+		{
+			sampledItemNumber = itemsPut;
+			sampleStartTime = clock();
+			samplePending.store(true, std::memory_order_release);
+		}
+	}
+}
+
+inline void RingBufferStats::NoteGet(size_t numFetched) noexcept
+{
+	itemsGot += numFetched;
+	if (samplePending.load(std::memory_order_acquire) && (int32_t)(itemsGot - sampledItemNumber) >= 0)
+	{
+		const ClockFunction f = clock;
+		if (f != nullptr)
+		{
+			const uint32_t residenceTime = f() - sampleStartTime;
+			++residenceSamples;
+			totalResidenceTime += residenceTime;
+			if (residenceTime > maxResidenceTime)
+			{
+				maxResidenceTime = residenceTime;
+			}
+		}
+		samplePending.store(false, std::memory_order_release);
+	}
+}
+
+#endif
+
+// Ring buffer template, used for serial I/O. Use RingBuffer or StaticRingBuffer, which provide the storage.
 // We assume the items are small (e.g. characters, floats) so we pass them by value in PutItem
 // We use memcpy to copy them, so they must not have non-trivial copy constructors/assignment operators
+// Max one putter and one getter may use the buffer concurrently. They may be in different tasks, ISRs or cores.
+// The indices are atomic and use acquire/release ordering, so that data stored by the putter is visible to the getter before the new put index is, and vice versa.
+// The putter and getter state are kept in separate cache lines, and each side keeps a copy of the other side's index so that it only needs to read the shared one when the buffer appears full or empty.
 
-template<class T> class RingBuffer
+template<class T, class Storage> class RingBufferBase : protected Storage
 {
 public:
-	RingBuffer() noexcept;
-
-	// Initialise and allocate the buffer. numSlots must be a power of 2.
-	void Init(size_t numSlots) noexcept;
+	RingBufferBase() noexcept;
 
 	// Store one item returning true if successful
 	bool PutItem(T val) noexcept;
@@ -38,6 +203,19 @@ public:
 	// Get a block returning the number of items actually fetched
 	size_t GetBlock(T* _ecv_array buffer, size_t buflen) noexcept;
 
+	// Zero-copy write access, e.g. for DMA. Get a contiguous region of free slots of at most maxItems length, store items in it, then call CommitWrite.
+	// The region may be shorter than the total free space if the free space wraps round the end of the storage.
+	RingBufferSpan<T> ReserveWrite(size_t maxItems) noexcept;
+
+	// Make the first numItems items of the region returned by the last call to ReserveWrite available to the getter
+	void CommitWrite(size_t numItems) noexcept;
+
+	// Zero-copy read access. Get the regions of storage holding the items present, read items from them, then call Consume.
+	RingBufferReadSpans<T> PeekRead() noexcept;
+
+	// Release the first numItems items of those returned by the last call to PeekRead
+	void Consume(size_t numItems) noexcept;
+
 	// Return the number of items we could currently add to the buffer
 	size_t SpaceLeft() const noexcept;
 
@@ -48,87 +226,205 @@ public:
 	bool IsEmpty() const noexcept;
 
 	// Return the capacity
-	size_t GetCapacity() const noexcept { return capacity; }
+	size_t GetCapacity() const noexcept { return this->Capacity(); }
 
-	// Clear the buffer
-	void Clear() { getIndex = putIndex = 0; }
+	// Clear the buffer. Must not be called while the buffer is being accessed by a putter or getter.
+	void Clear() noexcept;
+
+	// Give the buffer a name and include it in statistics reports. 'name' must be in global storage. Does nothing unless RING_BUFFER_STATS is defined.
+	void RegisterStats(const char *_ecv_array name) noexcept
+	{
+#ifdef RING_BUFFER_STATS
+		stats.Register(name);
+#else
+		(void)name;
+#endif
+	}
+
+#ifdef RING_BUFFER_STATS
+	const RingBufferStats& GetStats() const noexcept { return stats; }
+	void ResetStats() noexcept { stats.Reset(); }
+#endif
 
 private:
-	size_t capacity;			// must be one less than a power of 2
+	// Statistics hooks, which compile to nothing unless RING_BUFFER_STATS is defined
+	void NotePut(size_t numStored, size_t numWanted, bool isBlock) noexcept;
+	void NoteGet(size_t numFetched) noexcept;
+
+	// Return the amount of free space that the putter can use, refreshing its copy of the get index if it has less than 'wanted'
+	size_t PutterSpace(size_t currentPutIndex, size_t wanted) noexcept;
+
+	// Return the number of items that the getter can fetch, refreshing its copy of the put index if it has less than 'wanted'
+	size_t GetterItems(size_t currentGetIndex, size_t wanted) noexcept;
 
-	// Declare the data volatile so that it can be accessed by multiple threads or ISRs (but max 1 getter and 1 putter concurrently)
-	volatile size_t putIndex, getIndex;
-	volatile T * _ecv_array _ecv_null data;
+	// Putter state. Only the putter writes these.
+	alignas(CacheLineSize) std::atomic<size_t> putIndex;
+	size_t cachedGetIndex;							// the putter's copy of getIndex
+
+	// Getter state. Only the getter writes these.
+	alignas(CacheLineSize) std::atomic<size_t> getIndex;
+	size_t cachedPutIndex;							// the getter's copy of putIndex
+
+#ifdef RING_BUFFER_STATS
+	RingBufferStats stats;
+#endif
 };
 
-template<class T> RingBuffer<T>::RingBuffer() noexcept
-	: capacity(0), putIndex(0), getIndex(0), data(nullptr)
+template<class T, class Storage> RingBufferBase<T, Storage>::RingBufferBase() noexcept
+	: putIndex(0), cachedGetIndex(0), getIndex(0), cachedPutIndex(0)
 {
 }
 
-template<class T> void RingBuffer<T>::Init(size_t numSlots) noexcept
+template<class T, class Storage> void RingBufferBase<T, Storage>::Clear() noexcept
 {
-	capacity = 0;
-	putIndex = 0;
-	getIndex = 0;
-	volatile T *oldData = nullptr;
-	std::swap(data, oldData);
-	delete[] oldData;
-	if (numSlots > 1)
+	putIndex.store(0, std::memory_order_relaxed);
+	getIndex.store(0, std::memory_order_relaxed);
+	cachedGetIndex = cachedPutIndex = 0;
+}
+
+template<class T, class Storage> inline void RingBufferBase<T, Storage>::NotePut(size_t numStored, size_t numWanted, bool isBlock) noexcept
+{
+#ifdef RING_BUFFER_STATS
+	stats.NotePut(numStored, numWanted, ItemsPresent(), isBlock);
+#else
+	(void)numStored;
+	(void)numWanted;
+	(void)isBlock;
+#endif
+}
+
+template<class T, class Storage> inline void RingBufferBase<T, Storage>::NoteGet(size_t numFetched) noexcept
+{
+#ifdef RING_BUFFER_STATS
+	stats.NoteGet(numFetched);
+#else
+	(void)numFetched;
+#endif
+}
+
+template<class T, class Storage> inline size_t RingBufferBase<T, Storage>::PutterSpace(size_t currentPutIndex, size_t wanted) noexcept
+{
+	size_t space = (cachedGetIndex + this->Capacity() - currentPutIndex) & this->Capacity();
+	if (space < wanted)
+	{
+		// Acquire ordering ensures that the getter has finished reading the slots it has released before we overwrite them
+		cachedGetIndex = getIndex.load(std::memory_order_acquire);
+		space = (cachedGetIndex + this->Capacity() - currentPutIndex) & this->Capacity();
+	}
+	return space;
+}
+
+template<class T, class Storage> inline size_t RingBufferBase<T, Storage>::GetterItems(size_t currentGetIndex, size_t wanted) noexcept
+{
+	size_t present = (cachedPutIndex - currentGetIndex) & this->Capacity();
+	if (present < wanted)
 	{
-		capacity = numSlots - 1;
-		data = new T[numSlots];
+		// Acquire ordering ensures that we see the data that the putter stored before it advanced putIndex
+		cachedPutIndex = putIndex.load(std::memory_order_acquire);
+		present = (cachedPutIndex - currentGetIndex) & this->Capacity();
 	}
+	return present;
 }
 
-template<class T> inline bool RingBuffer<T>::PutItem(T val) noexcept
+template<class T, class Storage> inline bool RingBufferBase<T, Storage>::PutItem(T val) noexcept
 {
-	const size_t oldPutIndex = putIndex;				// capture volatile
-	const size_t newPutIndex = (oldPutIndex + 1) & capacity;
-	if (newPutIndex != getIndex)
+	const size_t currentPutIndex = putIndex.load(std::memory_order_relaxed);		// only we write putIndex
+	if (PutterSpace(currentPutIndex, 1) != 0)
 	{
-		not_null(data)[oldPutIndex] = val;
-		putIndex = newPutIndex;
+		this->Data()[currentPutIndex] = val;
+		putIndex.store((currentPutIndex + 1) & this->Capacity(), std::memory_order_release);
+		NotePut(1, 1, false);
 		return true;
 	}
+	NotePut(0, 1, false);
 	return false;
 }
 
-template<class T> inline bool RingBuffer<T>::GetItem(T& val) noexcept
+template<class T, class Storage> inline bool RingBufferBase<T, Storage>::GetItem(T& val) noexcept
 {
-	const size_t currentGetIndex = getIndex;			// capture volatile
-	if (currentGetIndex != putIndex)
+	const size_t currentGetIndex = getIndex.load(std::memory_order_relaxed);		// only we write getIndex
+	if (GetterItems(currentGetIndex, 1) != 0)
 	{
-		val = not_null(data)[currentGetIndex];
-		getIndex = (currentGetIndex + 1) & capacity;
+		val = this->Data()[currentGetIndex];
+		getIndex.store((currentGetIndex + 1) & this->Capacity(), std::memory_order_release);
+		NoteGet(1);
 		return true;
 	}
 	return false;
 }
 
-template<class T> inline size_t RingBuffer<T>::SpaceLeft() const noexcept
+template<class T, class Storage> RingBufferSpan<T> RingBufferBase<T, Storage>::ReserveWrite(size_t maxItems) noexcept
 {
-	return (getIndex + capacity - putIndex) & capacity;
+	const size_t currentPutIndex = putIndex.load(std::memory_order_relaxed);
+	size_t toReserve = PutterSpace(currentPutIndex, maxItems);
+	if (toReserve > this->Capacity() + 1 - currentPutIndex)
+	{
+		toReserve = this->Capacity() + 1 - currentPutIndex;			// don't go past the end of the storage
+	}
+	if (toReserve > maxItems)
+	{
+		toReserve = maxItems;
+	}
+	return RingBufferSpan<T>{ (toReserve == 0) ? nullptr : this->Data() + currentPutIndex, toReserve };
 }
 
-template<class T> inline size_t RingBuffer<T>::ItemsPresent() const noexcept
+template<class T, class Storage> inline void RingBufferBase<T, Storage>::CommitWrite(size_t numItems) noexcept
 {
-	return (putIndex - getIndex) & capacity;
+	putIndex.store((putIndex.load(std::memory_order_relaxed) + numItems) & this->Capacity(), std::memory_order_release);
+	NotePut(numItems, numItems, true);
 }
 
-template<class T> inline bool RingBuffer<T>::IsEmpty() const noexcept
+template<class T, class Storage> RingBufferReadSpans<T> RingBufferBase<T, Storage>::PeekRead() noexcept
 {
-	return getIndex == putIndex;
+	const size_t currentGetIndex = getIndex.load(std::memory_order_relaxed);
+	const size_t present = GetterItems(currentGetIndex, this->Capacity());		// ask for the whole capacity so that we pick up everything the putter has stored
+	const size_t toEnd = this->Capacity() + 1 - currentGetIndex;
+	RingBufferReadSpans<T> spans;
+	if (present == 0)
+	{
+		spans.first = RingBufferSpan<T>{ nullptr, 0 };
+		spans.second = RingBufferSpan<T>{ nullptr, 0 };
+	}
+	else if (present <= toEnd)
+	{
+		spans.first = RingBufferSpan<T>{ this->Data() + currentGetIndex, present };
+		spans.second = RingBufferSpan<T>{ nullptr, 0 };
+	}
+	else
+	{
+		spans.first = RingBufferSpan<T>{ this->Data() + currentGetIndex, toEnd };
+		spans.second = RingBufferSpan<T>{ this->Data(), present - toEnd };
+	}
+	return spans;
+}
+
+template<class T, class Storage> inline void RingBufferBase<T, Storage>::Consume(size_t numItems) noexcept
+{
+	getIndex.store((getIndex.load(std::memory_order_relaxed) + numItems) & this->Capacity(), std::memory_order_release);
+	NoteGet(numItems);
+}
+
+template<class T, class Storage> inline size_t RingBufferBase<T, Storage>::SpaceLeft() const noexcept
+{
+	return (getIndex.load(std::memory_order_acquire) + this->Capacity() - putIndex.load(std::memory_order_acquire)) & this->Capacity();
+}
+
+template<class T, class Storage> inline size_t RingBufferBase<T, Storage>::ItemsPresent() const noexcept
+{
+	return (putIndex.load(std::memory_order_acquire) - getIndex.load(std::memory_order_acquire)) & this->Capacity();
+}
+
+template<class T, class Storage> inline bool RingBufferBase<T, Storage>::IsEmpty() const noexcept
+{
+	return getIndex.load(std::memory_order_acquire) == putIndex.load(std::memory_order_acquire);
 }
 
-template<class T> size_t RingBuffer<T>::PutBlock(const T* _ecv_array buffer, size_t buflen) noexcept
+template<class T, class Storage> size_t RingBufferBase<T, Storage>::PutBlock(const T* _ecv_array buffer, size_t buflen) noexcept
 {
-	// Capture volatile variables to avoid reloading them unnecessarily
-	const size_t currentGetIndex = getIndex;
-	size_t currentPutIndex = putIndex;
+	size_t currentPutIndex = putIndex.load(std::memory_order_relaxed);
 
 	// See how much room there is in the buffer and how much we can store
-	size_t toCopy = (currentGetIndex + capacity - currentPutIndex) & capacity;
+	size_t toCopy = PutterSpace(currentPutIndex, buflen);
 	if (buflen < toCopy)
 	{
 		toCopy = buflen;
@@ -136,41 +432,32 @@ template<class T> size_t RingBuffer<T>::PutBlock(const T* _ecv_array buffer, siz
 
 	if (toCopy != 0)
 	{
-		size_t toCopyNext;
-		if (currentGetIndex <= currentPutIndex)
+		// Store items from currentPutIndex up to the end of the buffer, then wrap round if necessary
+		const size_t toCopyFirst = this->Capacity() + 1 - currentPutIndex;
+		if (toCopy < toCopyFirst)
 		{
-			// Start by storing items from currentPutIndex up to the end of the buffer
-			size_t toCopyFirst = capacity + 1 - currentPutIndex;
-			if (toCopy < toCopyFirst)
-			{
-				// We don't reach the end of the buffer
-				memcpy(const_cast<T* _ecv_array>(not_null(data)) + currentPutIndex, buffer, toCopy * sizeof(T));
-				putIndex = currentPutIndex + toCopy;
-				return toCopy;
-			}
-			memcpy(const_cast<T* _ecv_array>(not_null(data)) + currentPutIndex, buffer, toCopyFirst * sizeof(T));
-			currentPutIndex = 0;
-			toCopyNext = toCopy - toCopyFirst;
-			buffer += toCopyFirst;
+			// We don't reach the end of the buffer
+			memcpy(this->Data() + currentPutIndex, buffer, toCopy * sizeof(T));
+			putIndex.store(currentPutIndex + toCopy, std::memory_order_release);
 		}
 		else
 		{
-			toCopyNext = toCopy;
+			memcpy(this->Data() + currentPutIndex, buffer, toCopyFirst * sizeof(T));
+			currentPutIndex = toCopy - toCopyFirst;
+			memcpy(this->Data(), buffer + toCopyFirst, currentPutIndex * sizeof(T));
+			putIndex.store(currentPutIndex, std::memory_order_release);
 		}
-		memcpy(const_cast<T* _ecv_array>(not_null(data)) + currentPutIndex, buffer, toCopyNext * sizeof(T));
-		putIndex = currentPutIndex + toCopyNext;
 	}
+	NotePut(toCopy, buflen, true);
 	return toCopy;
 }
 
-template<class T> size_t RingBuffer<T>::GetBlock(T* _ecv_array buffer, size_t buflen) noexcept
+template<class T, class Storage> size_t RingBufferBase<T, Storage>::GetBlock(T* _ecv_array buffer, size_t buflen) noexcept
 {
-	// Capture volatile variables to avoid reloading them unnecessarily
-	size_t currentGetIndex = getIndex;
-	const size_t currentPutIndex = putIndex;
+	size_t currentGetIndex = getIndex.load(std::memory_order_relaxed);
 
 	// See how much data there is in the buffer and how much we can fetch
-	size_t toCopy = (currentPutIndex - currentGetIndex) & capacity;
+	size_t toCopy = GetterItems(currentGetIndex, buflen);
 	if (buflen < toCopy)
 	{
 		toCopy = buflen;
@@ -178,31 +465,51 @@ template<class T> size_t RingBuffer<T>::GetBlock(T* _ecv_array buffer, size_t bu
 
 	if (toCopy != 0)
 	{
-		size_t toCopyNext;
-		if (currentGetIndex > currentPutIndex)
+		// Fetch items from currentGetIndex up to the end of the buffer, then wrap round if necessary
+		const size_t toCopyFirst = this->Capacity() + 1 - currentGetIndex;
+		if (toCopy < toCopyFirst)
 		{
-			// Start by fetching items from currentGetIndex up to the end of the buffer
-			const size_t toCopyFirst = capacity + 1 - currentGetIndex;
-			if (toCopy < toCopyFirst)
-			{
-				// We don't reach the end of the buffer
-				memcpy(buffer, const_cast<const T* _ecv_array>(not_null(data)) + currentGetIndex, toCopy * sizeof(T));
-				getIndex = currentGetIndex + toCopy;
-				return toCopy;
-			}
-			memcpy(buffer, const_cast<const T* _ecv_array>(not_null(data)) + currentGetIndex, toCopyFirst * sizeof(T));
-			currentGetIndex = 0;
-			toCopyNext = toCopy - toCopyFirst;
-			buffer += toCopyFirst;
+			// We don't reach the end of the buffer
+			memcpy(buffer, this->Data() + currentGetIndex, toCopy * sizeof(T));
+			getIndex.store(currentGetIndex + toCopy, std::memory_order_release);
 		}
 		else
 		{
-			toCopyNext = toCopy;
+			memcpy(buffer, this->Data() + currentGetIndex, toCopyFirst * sizeof(T));
+			currentGetIndex = toCopy - toCopyFirst;
+			memcpy(buffer + toCopyFirst, this->Data(), currentGetIndex * sizeof(T));
+			getIndex.store(currentGetIndex, std::memory_order_release);
 		}
-		memcpy(buffer, const_cast<const T* _ecv_array>(not_null(data)) + currentGetIndex, toCopyNext * sizeof(T));
-		getIndex = currentGetIndex + toCopyNext;
+		NoteGet(toCopy);
 	}
 	return toCopy;
 }
 
+// Ring buffer whose storage is allocated from the heap when Init is called
+template<class T> class RingBuffer : public RingBufferBase<T, RingBufferHeapStorage<T>>
+{
+public:
+	// Initialise and allocate the buffer. numSlots must be a power of 2.
+	void Init(size_t numSlots) noexcept;
+};
+
+template<class T> void RingBuffer<T>::Init(size_t numSlots) noexcept
+{
+	this->capacity = 0;
+	this->Clear();
+	T *oldData = nullptr;
+	std::swap(this->data, oldData);
+	delete[] oldData;
+	if (numSlots > 1)
+	{
+		this->capacity = numSlots - 1;
+		this->data = new T[numSlots];
+	}
+}
+
+// Ring buffer with inline storage for N items, where N is a power of 2. It needs no heap and no call to Init.
+template<class T, size_t N> class StaticRingBuffer : public RingBufferBase<T, RingBufferInlineStorage<T, N>>
+{
+};
+
 #endif /* SRC_GENERAL_RINGBUFFER_H_ */
@@ -34,6 +34,9 @@
 #include <cmath>
 
 #include "Strnlen.h"
+#include "StringRef.h"
+#include "FloatToDecimal.h"
+#include "IntegerToDecimal.h"
 
 // The following should be enough for 32-bit int/long and 64-bit long long
 constexpr size_t MaxLongDigits = 10;	// to print 4294967296
@@ -70,34 +73,115 @@ struct xPrintFlags
 	}
 };
 
+// Source of arguments that reads them from a va_list
+class VaListArgs
+{
+public:
+	explicit VaListArgs(va_list a) noexcept { va_copy(args, a); }
+	~VaListArgs() noexcept { va_end(args); }
+	VaListArgs(const VaListArgs&) = delete;
+	VaListArgs& operator=(const VaListArgs&) = delete;
+
+	int GetInt() noexcept { return va_arg(args, int); }
+	long long GetLongLong() noexcept { return va_arg(args, long long); }
+	double GetDouble() noexcept { return va_arg(args, double); }
+	const char *_ecv_array null GetString() noexcept { return va_arg(args, const char *_ecv_array null); }
+	size_t GetIndex() const noexcept { return 0; }						// printing from a va_list can't be resumed, so we don't count the arguments
+
+private:
+	va_list args;
+};
+
+// Source of arguments that reads them from the values saved by a ResumablePrinter
+class CapturedArgs
+{
+public:
+	CapturedArgs(const CapturedPrintArg *_ecv_array a, size_t n, size_t startIndex) noexcept : args(a), numArgs(n), index(startIndex) { }
+
+	int GetInt() noexcept { return (int)Next().i; }
+	long long GetLongLong() noexcept { return Next().i; }
+	double GetDouble() noexcept { return Next().f; }
+	const char *_ecv_array null GetString() noexcept { return Next().s; }
+	size_t GetIndex() const noexcept { return index; }
+
+private:
+	// Return the next argument. If the format uses more arguments than were saved then return zero, which is also a null string pointer.
+	CapturedPrintArg Next() noexcept
+	{
+		if (index < numArgs)
+		{
+			return args[index++];
+		}
+		CapturedPrintArg zero;
+		zero.i = 0;
+		return zero;
+	}
+
+	const CapturedPrintArg *_ecv_array args;
+	size_t numArgs;
+	size_t index;
+};
+
 class FormattedPrinter
 {
 public:
-	explicit FormattedPrinter(const PutcFunc_t& pcf) noexcept;
-	int Print(const char *_ecv_array format, va_list args) noexcept;
+	explicit FormattedPrinter(PrintSink& s, bool measure = false) noexcept;
+	template<class ArgSource> int Print(const char *_ecv_array format, ArgSource& args) noexcept;
+
+	bool PrintConversion(const FormatConversion& conv, long long val) noexcept;
+	bool PrintConversion(const FormatConversion& conv, double val) noexcept;
+	bool PrintConversion(const FormatConversion& conv, const char *_ecv_array null s) noexcept;
+	int GetLength() const noexcept { return curLen; }
+
+	// Return true if printing stopped because the sink became full, and if so where to continue from
+	bool SinkBecameFull() const noexcept { return sinkFull; }
+	void GetResumePoint(const char *_ecv_array& format, size_t& argIndex, size_t& charsDone) const noexcept;
 
 private:
-	PutcFunc_t putcharFunc;
+	PrintSink& sink;
 	int curLen;
 	xPrintFlags flags;
+	const char *_ecv_array null itemStart;			// where the item being printed starts in the format
+	size_t itemArgIndex;							// the index of the first argument that the item uses
+	int itemStartLength;							// the value of curLen when we started printing the item
+	bool sinkFull;
+	const bool measureOnly;							// true if the sink is a MeasureSink, so we only need to count the characters
 
 	void Init() noexcept;
+	void StartItem(const char *_ecv_array format, size_t argIndex) noexcept
+	{
+		itemStart = format;
+		itemArgIndex = argIndex;
+		itemStartLength = curLen;
+	}
+	void SetConversion(const FormatConversion& conv) noexcept;
 	bool PutString(const char *_ecv_array apString) noexcept;
 	bool PutJson(const char *_ecv_array apString) noexcept;
 	bool PrintLL(long long i) noexcept;
 	bool PrintI(int i) noexcept;
 	bool PrintFloat(double d, char formatLetter) noexcept;
+	long long ScaleFloat(float f, char& formatLetter, int& exponent, int& digitsAfterPoint) noexcept;
+	long long ScaleDouble(double d, char& formatLetter, int& exponent, int& digitsAfterPoint) noexcept;
 	bool PutChar(char c) noexcept;
+	bool PutChars(const char *_ecv_array s, size_t len) noexcept;
+	bool PutFill(char c, int count) noexcept;
 	bool PutStringWithSign(char *_ecv_array s, bool isNegative) noexcept;
 	bool DoPrefix() noexcept;
 };
 
-FormattedPrinter::FormattedPrinter(const PutcFunc_t& pcf) noexcept
-	: putcharFunc(pcf), curLen(0)
+FormattedPrinter::FormattedPrinter(PrintSink& s, bool measure) noexcept
+	: sink(s), curLen(0), itemStart(nullptr), itemArgIndex(0), itemStartLength(0), sinkFull(false), measureOnly(measure)
 {
 	Init();
 }
 
+void FormattedPrinter::GetResumePoint(const char *_ecv_array& format, size_t& argIndex, size_t& charsDone) const noexcept
+{
+	format = itemStart;
+	argIndex = itemArgIndex;
+	charsDone = (size_t)(curLen - itemStartLength);
+}
+
 void FormattedPrinter::Init() noexcept
 {
 	flags.base = flags.width = 0;
@@ -105,14 +189,40 @@ void FormattedPrinter::Init() noexcept
 	flags.u.all = 0;
 }
 
+// Output a single character, which must not be null
 bool FormattedPrinter::PutChar(char c) noexcept
 {
-	const bool ret = putcharFunc(c) && c != 0;
-	if (ret)
+	return PutChars(&c, 1);
+}
+
+// Output a block of characters, returning true if they were all accepted
+bool FormattedPrinter::PutChars(const char *_ecv_array s, size_t len) noexcept
+{
+	const size_t written = sink.Write(s, len);
+	curLen += (int)written;
+	if (written != len)
 	{
-		++curLen;
+		sinkFull = true;
+		return false;
 	}
-	return ret;
+	return true;
+}
+
+// Output 'count' copies of a padding character
+bool FormattedPrinter::PutFill(char c, int count) noexcept
+{
+	if (count <= 0)
+	{
+		return true;
+	}
+	const size_t written = sink.Fill(c, (size_t)count);
+	curLen += (int)written;
+	if (written != (size_t)count)
+	{
+		sinkFull = true;
+		return false;
+	}
+	return true;
 }
 
 /*-----------------------------------------------------------*/
@@ -132,12 +242,11 @@ bool FormattedPrinter::PutString(const char *_ecv_array apString) noexcept
 		count = (int)strlen(apString);
 	}
 
-	int rightSpacesNeeded = 0;
+	int leftSpacesNeeded = 0, leftZerosNeeded = 0, rightSpacesNeeded = 0;
 	const bool hasMinimumDigits = (flags.u.b.isNumber && flags.printLimit > 0);
 	if (hasMinimumDigits || flags.width > 0)
 	{
 		// We may have some padding to do
-		int leftSpacesNeeded = 0, leftZerosNeeded = 0;
 		if (hasMinimumDigits && count < flags.printLimit)
 		{
 			leftZerosNeeded = flags.printLimit - count;
@@ -158,99 +267,95 @@ bool FormattedPrinter::PutString(const char *_ecv_array apString) noexcept
 				leftSpacesNeeded = remainingPaddingNeeded;
 			}
 		}
-
-		// Do the left padding
-		while (leftSpacesNeeded > 0)
-		{
-			if (!PutChar(' '))
-			{
-				return false;
-			}
-			--leftSpacesNeeded;
-		}
-		while (leftZerosNeeded > 0)
-		{
-			if (!PutChar('0'))
-			{
-				return false;
-			}
-			--leftZerosNeeded;
-		}
 	}
 
-	// Now print the actual string
-	while (count > 0)
+	if (measureOnly)
 	{
-		if (!PutChar(*apString++))
-		{
-			return false;
-		}
-		--count;
+		// We already know the length, so there is no need to pass the string and padding to the sink
+		curLen += leftSpacesNeeded + leftZerosNeeded + count + rightSpacesNeeded;
+		return true;
 	}
 
-	// Now the right padding
-	while (rightSpacesNeeded > 0)
+	// Print the left padding, the actual string and the right padding
+	return PutFill(' ', leftSpacesNeeded) && PutFill('0', leftZerosNeeded) && PutChars(apString, (size_t)count) && PutFill(' ', rightSpacesNeeded);
+}
+
+// Table that classifies characters when writing JSON strings, so that runs of characters that don't need escaping can be found quickly.
+// Each entry is 0 if the character is written unchanged, JsonReplace if it is a control character that we replace by '?',
+// JsonEnd for the null terminator, else the character to write after a backslash.
+constexpr uint8_t JsonReplace = 1;
+constexpr uint8_t JsonEnd = 2;
+
+struct JsonEscapeTable
+{
+	uint8_t entries[256];
+
+	constexpr JsonEscapeTable() noexcept : entries()
 	{
-		if (!PutChar(' '))
+		for (unsigned int i = 0; i < 0x20; ++i)
 		{
-			return false;
+			entries[i] = JsonReplace;					// don't print control characters to JSON strings
 		}
-		--rightSpacesNeeded;
+		entries[0] = JsonEnd;
+		entries[(uint8_t)'\r'] = 'r';
+		entries[(uint8_t)'\n'] = 'n';
+		entries[(uint8_t)'\t'] = 't';
+		entries[(uint8_t)'"'] = '"';
+		entries[(uint8_t)'\\'] = '\\';
+		// Escaping '/' is optional in JSON, although doing so so confuses PanelDue (fixed in PanelDue firmware version 1.15 and later). As it's optional, we don't do it.
 	}
+};
 
-	return true;
-}
+static constexpr JsonEscapeTable JsonEscapes;
 
 // Write a string in JSON format returning true if successful. Width specifiers are ignored.
 bool FormattedPrinter::PutJson(const char *_ecv_array apString) noexcept
 {
-	bool ok = true;
-	while (ok)
+	if (measureOnly)
 	{
-		const char c = *apString;
-		char esc;
-		switch (c)
+		// Count the characters without passing them to the sink. Escaped characters need two characters, replaced ones need one.
+		for (uint8_t esc; (esc = JsonEscapes.entries[(uint8_t)*apString]) != JsonEnd; ++apString)
 		{
-		case '\0':
-			return true;
-		case '\r':
-			esc = 'r';
-			break;
-		case '\n':
-			esc = 'n';
-			break;
-		case '\t':
-			esc = 't';
-			break;
-		case '"':
-		case '\\':
-#if 1
-		// Escaping '/' is optional in JSON, although doing so so confuses PanelDue (fixed in PanelDue firmware version 1.15 and later). As it's optional, we don't do it.
-#else
-		case '/':
-#endif
-			esc = c;
-			break;
-		default:
-			esc = 0;
-			break;
+			curLen += (esc > JsonEnd) ? 2 : 1;
+		}
+		return true;
+	}
+
+	for (;;)
+	{
+		// Output the run of characters that don't need escaping in one go
+		const char *_ecv_array const runStart = apString;
+		uint8_t esc;
+		while ((esc = JsonEscapes.entries[(uint8_t)*apString]) == 0)
+		{
+			++apString;
+		}
+		if (apString != runStart && !PutChars(runStart, (size_t)(apString - runStart)))
+		{
+			return false;
 		}
 
-		if (esc != 0)
+		if (esc == JsonEnd)
 		{
-			ok = PutChar('\\') && PutChar(esc);
+			return true;
 		}
-		else if (c < 0x20)
+		if (esc == JsonReplace)
 		{
-			ok = PutChar('?');		// don't print control characters to JSON strings
+			if (!PutChar('?'))
+			{
+				return false;
+			}
 		}
 		else
 		{
-			ok = PutChar(c);
+			const char escSequence[2] = { '\\', (char)esc };
+			if (!PutChars(escSequence, 2))
+			{
+				return false;
+			}
 		}
 		++apString;
 	}
-	return false;
 }
 
 // Output the string representation of the number to be printed, with a sign uf necessary, padded as required
@@ -323,15 +428,25 @@ bool FormattedPrinter::PrintLL(long long i) noexcept
 	char print_buf[MaxUllDigits + 2];
 	char *_ecv_array s = print_buf + sizeof print_buf - 1;
 	*s = '\0';
-	while (u != 0)
+	if (flags.base == 10)
+	{
+		s = WriteU64DecimalBackwards(u, s);
+	}
+	else
 	{
-		unsigned int t = u % (unsigned int)flags.base;
-		u /= (unsigned int)flags.base;
-		if (t >= 10)
+		// The base is 16 or 8, so we can shift instead of doing 64-bit division
+		const unsigned int shift = (flags.base == 16) ? 4 : 3;
+		const unsigned int mask = (unsigned int)flags.base - 1;
+		while (u != 0)
 		{
-			t += flags.u.b.letBase - ((unsigned int)'0' + 10);
+			unsigned int t = (unsigned int)u & mask;
+			u >>= shift;
+			if (t >= 10)
+			{
+				t += flags.u.b.letBase - ((unsigned int)'0' + 10);
+			}
+			*--s = (char)(t + (unsigned int)'0');
 		}
-		*--s = (char)(t + (unsigned int)'0');
 	}
 
 	return PutStringWithSign(s, neg);
@@ -382,15 +497,16 @@ bool FormattedPrinter::PrintI(int i) noexcept
 		break;
 
 	case 8:
-	case 10:
-		// GCC compiles very efficient
 		while (u != 0)
 		{
-			const unsigned int t = u % base;
-			*--s = (char)(t + (unsigned int)'0');
-			u /= base;
+			*--s = (char)((u & 7u) + (unsigned int)'0');
+			u >>= 3;
 		}
 		break;
+
+	case 10:
+		s = WriteU32DecimalBackwards(u, s);
+		break;
 #if 0
 	// The generic case, not yet in use
 	default:
@@ -415,26 +531,172 @@ bool FormattedPrinter::PrintI(int i) noexcept
 
 #ifndef NO_PRINTF_FLOAT
 
+constexpr int MaxDigitsAfterPoint = 17;					// the most decimal digits we print, so that the scaled value fits in a long long
+
+// If a double holds a value that a float can represent exactly, e.g. because it is a float argument that has been promoted to double, convert it and return true.
+// This uses integer operations only, because double precision arithmetic and conversions are done in software on our processors.
+static bool GetExactFloat(uint64_t doubleBits, float& f) noexcept
+{
+	const unsigned int biasedExponent = (unsigned int)(doubleBits >> 52) & 0x07FFu;
+	uint32_t floatBits;
+	if (biasedExponent == 0 && (doubleBits & 0x000FFFFFFFFFFFFFull) == 0)
+	{
+		floatBits = 0;														// zero
+	}
+	else if (biasedExponent >= 1023 - 126 && biasedExponent <= 1023 + 127 && (doubleBits & 0x1FFFFFFFu) == 0)
+	{
+		floatBits = ((biasedExponent - (1023 - 127)) << 23) | (uint32_t)((doubleBits >> 29) & 0x007FFFFFu);
+	}
+	else if (biasedExponent >= 1023 - 149 && biasedExponent < 1023 - 126)
+	{
+		// The value may be a denormalised float
+		const unsigned int rightShift = 52 - (biasedExponent - (1023 - 149));
+		const uint64_t mantissa = (doubleBits & 0x000FFFFFFFFFFFFFull) | 0x0010000000000000ull;
+		if ((mantissa & (((uint64_t)1 << rightShift) - 1)) != 0)
+		{
+			return false;
+		}
+		floatBits = (uint32_t)(mantissa >> rightShift);
+	}
+	else
+	{
+		return false;
+	}
+	memcpy(&f, &floatBits, sizeof(f));										// we don't need the sign
+	return true;
+}
+
 // Print a number in scientific format
 // flags.printLimit is the number of decimal digits required
 bool FormattedPrinter::PrintFloat(double d, char formatLetter) noexcept
 {
-	if (std::isnan(d))
+	uint64_t doubleBits;
+	memcpy(&doubleBits, &d, sizeof(doubleBits));
+	if ((doubleBits & 0x7FF0000000000000ull) == 0x7FF0000000000000ull)
+	{
+		return PutString(((doubleBits & 0x000FFFFFFFFFFFFFull) != 0) ? "nan" : "inf");
+	}
+
+	if (flags.printLimit < 0)
+	{
+		flags.printLimit = 6;					// set the default number of decimal digits
+	}
+
+	// Get the value multiplied by 10 to the power of the number of decimal digits to print, rounded to an integer.
+	// Float arguments are promoted to double, so this is exact when the argument was a float, and then we can avoid floating point arithmetic.
+	int exponent = 0;
+	int digitsAfterPoint;
+	float f;
+	long long u = (GetExactFloat(doubleBits, f)) ? ScaleFloat(f, formatLetter, exponent, digitsAfterPoint)
+					: ScaleDouble(d, formatLetter, exponent, digitsAfterPoint);
+
+	char print_buf[MaxUllDigits + MaxLongDigits + 5];
+	char *_ecv_array s = print_buf + sizeof print_buf - 1;
+	*s = '\0';
+
+	if (formatLetter == 'e' || formatLetter == 'E')
+	{
+		// Rounding may have caused 9.99999... to become 10
+		long long limit = 10;
+		for (int i = 0; i < digitsAfterPoint; ++i)
+		{
+			limit *= 10;
+		}
+		if (u >= limit)
+		{
+			u /= 10;
+			++exponent;
+		}
+
+		// Store the exponent
+		int iexp = abs(exponent);
+		do
+		{
+			*--s = (char)((iexp % 10) + (int)'0');
+			iexp = iexp/10;
+		} while (iexp != 0);
+		*--s = (exponent < 0) ? '-' : '+';
+		*--s = formatLetter;
+	}
+
+	// Store the non-exponent part, with leading zeros if necessary so that there is at least one digit before the decimal point
+	char *_ecv_array const digitsEnd = s;
+	s = (((uint64_t)u >> 32) == 0) ? WriteU32DecimalBackwards((uint32_t)u, s) : WriteU64DecimalBackwards((uint64_t)u, s);
+	while (digitsEnd - s <= digitsAfterPoint)
+	{
+		*--s = '0';
+	}
+
+	// Insert the decimal point by moving the digits before it down one place
+	if (digitsAfterPoint != 0 || flags.u.b.hash)
+	{
+		char *_ecv_array const point = digitsEnd - digitsAfterPoint - 1;
+		memmove(s - 1, s, (size_t)(point - s + 1));
+		--s;
+		*point = '.';
+	}
+
+	// Negative numbers that round to zero are printed with a minus sign, but negative zero isn't
+	return PutStringWithSign(s, (doubleBits & 0x8000000000000000ull) != 0 && (doubleBits & 0x7FFFFFFFFFFFFFFFull) != 0);
+}
+
+// Convert G format to E or F format given the exponent
+static char ResolveGFormat(char formatLetter, int exponent, int printLimit) noexcept
+{
+	return (exponent > -4 && exponent <= printLimit)
+			? (char)((int)formatLetter - 1)					// change g to f
+				: (char)((int)formatLetter - 2);			// change g to e
+}
+
+// Calculate the value to print from a float using exact integer arithmetic.
+// Update formatLetter to e or f, set the exponent if using exponent format, and set the number of decimal digits.
+long long FormattedPrinter::ScaleFloat(float f, char& formatLetter, int& exponent, int& digitsAfterPoint) noexcept
+{
+	uint32_t absBits;
+	memcpy(&absBits, &f, sizeof(absBits));
+	absBits &= 0x7FFFFFFFu;
+	if (absBits != 0 && formatLetter != 'f' && formatLetter != 'F')
+	{
+		exponent = FloatDecimalExponent(f);
+	}
+	if (formatLetter == 'g' || formatLetter == 'G')
+	{
+		formatLetter = ResolveGFormat(formatLetter, exponent, flags.printLimit);
+	}
+
+	// Do this after resolving G format, because that chooses F format for large numbers when the precision is high
+	if (absBits > 0x5F000000u && (formatLetter == 'f' || formatLetter == 'F'))
+	{
+		--formatLetter;			// number is greater than 2^63 so too big to print easily in fixed point format, so use exponent format
+		exponent = FloatDecimalExponent(f);
+	}
+
+	digitsAfterPoint = (flags.printLimit < MaxDigitsAfterPoint) ? flags.printLimit : MaxDigitsAfterPoint;
+	uint64_t u = 0;
+	if (formatLetter == 'e' || formatLetter == 'E')
 	{
-		return PutString("nan");
+		(void)ScaleFloatToInteger(f, digitsAfterPoint - exponent, u);		// this can't overflow because the result is less than 10^18
 	}
-	if (std::isinf(d))
+	else
 	{
-		return PutString("inf");
+		// Use fewer decimal digits if necessary so that the scaled value fits in a long long. The value is less than 2^63 so it always fits with no decimal digits.
+		while ((!ScaleFloatToInteger(f, digitsAfterPoint, u) || u >= (uint64_t)(LLONG_MAX/10) * 10) && digitsAfterPoint != 0)
+		{
+			--digitsAfterPoint;
+		}
 	}
+	return (long long)u;
+}
 
+// Calculate the value to print from a double. This loses some accuracy because multiplying or dividing by 10 isn't exact.
+long long FormattedPrinter::ScaleDouble(double d, char& formatLetter, int& exponent, int& digitsAfterPoint) noexcept
+{
 	double ud = fabs(d);
 	if (ud > (double)LLONG_MAX && (formatLetter == 'f' || formatLetter == 'F'))
 	{
 		--formatLetter;			// number is too big to print easily in fixed point format, so use exponent format
 	}
 
-	int exponent = 0;
 	if (formatLetter == 'e' || formatLetter == 'E' || formatLetter == 'g' || formatLetter == 'G')
 	{
 		// Using exponent format, so calculate the exponent and normalise ud to be >=1.0 but <10.0
@@ -463,105 +725,66 @@ bool FormattedPrinter::PrintFloat(double d, char formatLetter) noexcept
 			}
 		}
 		// ud is now at least 1.0 but less than 10.0 and exponent is the exponent
-	}
-
-	if (flags.printLimit < 0)
-	{
-		flags.printLimit = 6;					// set the default number of decimal digits
-	}
 
-	if (formatLetter == 'g' || formatLetter == 'G')
-	{
-		// Convert G format to E or F format
-	    if (exponent > -4 && exponent <= flags.printLimit)
-	    {
-	    	formatLetter = (char)((int)formatLetter - 1);					// change g to f
-	    	ud = fabs(d);						// restore original value of ud
-	    }
-	    else
-	    {
-	    	formatLetter = (char)((int)formatLetter - 2);					// change g to e
-	    }
-	}
-
-	// Multiply ud by 10 to the power of the number of decimal digits required, or until it becomes too big to print easily
-	int digitsAfterPoint = 0;
-	long limit = 10;
-	while (digitsAfterPoint < flags.printLimit && ud < (double)(LLONG_MAX/10) && limit <= LLONG_MAX/10)
-	{
-		ud *= (double)10.0;
-		limit *= 10;
-		 ++digitsAfterPoint;
-	}
-
-	char print_buf[MaxUllDigits + MaxLongDigits + 5];
-	char *_ecv_array s = print_buf + sizeof print_buf - 1;
-	*s = '\0';
-
-	long long u = llrint(ud);
-
-	if (formatLetter == 'e' || formatLetter == 'E')
-	{
-		// Rounding ud may have caused 9.99999... to become 10
-		if (u >= limit)
+		if (formatLetter == 'g' || formatLetter == 'G')
 		{
-			u /= 10;
-			++exponent;
+			formatLetter = ResolveGFormat(formatLetter, exponent, flags.printLimit);
+			if (formatLetter == 'f' || formatLetter == 'F')
+			{
+				if (fabs(d) > (double)LLONG_MAX)
+				{
+					--formatLetter;					// too big for fixed point format, so stay with exponent format
+				}
+				else
+				{
+					ud = fabs(d);					// restore original value of ud
+				}
+			}
 		}
-
-		// Store the exponent
-		int iexp = abs(exponent);
-		do
-		{
-			*--s = (char)((iexp % 10) + (int)'0');
-			iexp = iexp/10;
-		} while (iexp != 0);
-		*--s = (exponent < 0) ? '-' : '+';
-		*--s = formatLetter;
-	}
-
-	// Store the non-exponent part
-	if (digitsAfterPoint == 0 && !flags.u.b.hash)
-	{
-		--digitsAfterPoint;				// make digitsAfterPoint negative to suppress the decimal point
 	}
 
-	do
+	// Multiply ud by 10 to the power of the number of decimal digits required, or until it becomes too big to print easily
+	digitsAfterPoint = 0;
+	while (digitsAfterPoint < flags.printLimit && digitsAfterPoint < MaxDigitsAfterPoint && ud < (double)(LLONG_MAX/10))
 	{
-		if (digitsAfterPoint == 0)
-		{
-			*--s = '.';
-		}
-		--digitsAfterPoint;
-
-		const lldiv_t lldiv_result = lldiv(u, 10);
-		*--s = (char)((unsigned int)lldiv_result.rem + (unsigned int)'0');
-		u = lldiv_result.quot;
+		ud *= (double)10.0;
+		++digitsAfterPoint;
 	}
-	while (u != 0 || digitsAfterPoint >= 0);
 
-	return PutStringWithSign(s, d < (double)0.0);
+	return llrint(ud);
 }
 
 #endif
 
 /*-----------------------------------------------------------*/
 
-int FormattedPrinter::Print(const char *_ecv_array format, va_list args) noexcept
+// Print a format using arguments from a VaListArgs or CapturedArgs object.
+// We record where each item (a run of literal text or a conversion) starts, so that ResumablePrinter can continue from it if the sink becomes full.
+template<class ArgSource> int FormattedPrinter::Print(const char *_ecv_array format, ArgSource& args) noexcept
 {
 	for (;;)
 	{
-		char ch;
-		while ((ch = *format++) != '%')
+		// Output literal text up to the next format specifier in one go
+		const char *_ecv_array const literalStart = format;
+		StartItem(format, args.GetIndex());
+		while (*format != '%' && *format != '\0')
 		{
-			if (!PutChar(ch))
-			{
-				return curLen;
-			}
+			++format;
+		}
+		if (format != literalStart && !PutChars(literalStart, (size_t)(format - literalStart)))
+		{
+			return curLen;
+		}
+		if (*format == '\0')
+		{
+			sink.Finish();
+			return curLen;
 		}
+		StartItem(format, args.GetIndex());
+		++format;
 
-		// If we get here then ch == '%'. Get the next character.
-		ch = *format++;
+		// If we get here then we have just passed a '%'. Get the next character.
+		char ch = *format++;
 		if (ch == '\0')
 		{
 			break;
@@ -606,7 +829,7 @@ int FormattedPrinter::Print(const char *_ecv_array format, va_list args) noexcep
 		if (ch == '*')
 		{
 			ch = *format++;
-			flags.width = va_arg(args, int);
+			flags.width = args.GetInt();
 		}
 		else
 		{
@@ -621,7 +844,7 @@ int FormattedPrinter::Print(const char *_ecv_array format, va_list args) noexcep
 			ch = *format++;
 			if (ch == '*')
 			{
-				flags.printLimit = va_arg(args, int);
+				flags.printLimit = args.GetInt();
 				ch = *format++;
 			}
 			else
@@ -638,7 +861,7 @@ int FormattedPrinter::Print(const char *_ecv_array format, va_list args) noexcep
 #ifndef NO_PRINTF_FLOAT
 		if (ch == 'f' || ch == 'e' || ch == 'g' || ch == 'F' || ch == 'E' || ch == 'G')
 		{
-			if (!PrintFloat(va_arg(args, double), ch))
+			if (!PrintFloat(args.GetDouble(), ch))
 			{
 				break;
 			}
@@ -654,7 +877,7 @@ int FormattedPrinter::Print(const char *_ecv_array format, va_list args) noexcep
 
 		if (ch == 's')
 		{
-			const char *_ecv_array null s = va_arg(args, const char *_ecv_array null);
+			const char *_ecv_array null s = args.GetString();
 			flags.u.b.isString = true;
 			// RRF extension: if the current format specifier is exactly "%.s" then perform JSON escaping.
 			// We would like to use "%j" instead, but that gives rise to gcc warnings about unrecognised format specifiers and extra arguments.
@@ -675,7 +898,7 @@ int FormattedPrinter::Print(const char *_ecv_array format, va_list args) noexcep
 		if (ch == 'c')
 		{
 			// char are converted to int then pushed on the stack
-			const char c2 = (char)va_arg(args, int);
+			const char c2 = (char)args.GetInt();
 			if (c2 != 0)				// don't print it if it is null
 			{
 				if (!PutChar(c2))
@@ -712,12 +935,12 @@ int FormattedPrinter::Print(const char *_ecv_array format, va_list args) noexcep
 			flags.u.b.isSigned = (ch != 'u');
 			if (flags.u.b.long64)
 			{
-				if (!PrintLL(va_arg(args, long long)))
+				if (!PrintLL(args.GetLongLong()))
 				{
 					break;
 				}
 			}
-			else if (!PrintI(va_arg(args, int)))
+			else if (!PrintI(args.GetInt()))
 			{
 				break;
 			}
@@ -737,56 +960,324 @@ int FormattedPrinter::Print(const char *_ecv_array format, va_list args) noexcep
 			}
 			if (flags.u.b.long64)
 			{
-				if (!PrintLL(va_arg(args, long long)))
+				if (!PrintLL(args.GetLongLong()))
 				{
 					break;
 				}
 			}
-			else if (!PrintI(va_arg(args, int)))
+			else if (!PrintI(args.GetInt()))
 			{
 				break;
 			}
 			continue;
 		}
 	}
-	PutChar('\0');
+	sink.Finish();
 	return curLen;
 }
 
 /*-----------------------------------------------------------*/
 
+// Set up the flags from a pre-parsed conversion specification
+void FormattedPrinter::SetConversion(const FormatConversion& conv) noexcept
+{
+	Init();
+	flags.width = conv.width;
+	flags.printLimit = conv.precision;
+	flags.u.b.hash = (conv.flags & FormatConversion::Hash) != 0;
+	flags.u.b.padRight = (conv.flags & FormatConversion::PadRight) != 0;
+	flags.u.b.padZero = (conv.flags & FormatConversion::PadZero) != 0;
+	flags.u.b.forceSign = (conv.flags & FormatConversion::ForceSign) != 0;
+	flags.u.b.signOrSpace = (conv.flags & FormatConversion::SignOrSpace) != 0;
+}
+
+// Print an integer or character conversion in the same way as Print does
+bool FormattedPrinter::PrintConversion(const FormatConversion& conv, long long val) noexcept
+{
+	SetConversion(conv);
+	if (flags.printLimit == 0)
+	{
+		flags.printLimit = -1;
+	}
+
+	if (conv.letter == 'c')
+	{
+		const char c2 = (char)val;
+		return c2 == 0 || PutChar(c2);				// don't print it if it is null
+	}
+
+	flags.u.b.long64 = (conv.flags & FormatConversion::Long64) != 0;
+	flags.base = 10;
+	flags.u.b.letBase = (unsigned int)'a';
+	switch (conv.letter)
+	{
+	case 'd':
+	case 'i':
+		flags.u.b.isSigned = true;
+		break;
+
+	case 'X':
+		flags.u.b.letBase = (unsigned int)'A';
+		flags.base = 16;
+		break;
+
+	case 'x':
+	case 'p':
+		flags.base = 16;
+		break;
+
+	case 'o':
+		flags.base = 8;
+		break;
+
+	default:
+		break;
+	}
+
+	return (flags.u.b.long64) ? PrintLL(val) : PrintI((int)val);
+}
+
+// Print a floating point conversion in the same way as Print does
+bool FormattedPrinter::PrintConversion(const FormatConversion& conv, double val) noexcept
+{
+	SetConversion(conv);
+#ifndef NO_PRINTF_FLOAT
+	return PrintFloat(val, conv.letter);
+#else
+	return true;
+#endif
+}
+
+// Print a string conversion in the same way as Print does
+bool FormattedPrinter::PrintConversion(const FormatConversion& conv, const char *_ecv_array null s) noexcept
+{
+	SetConversion(conv);
+	if (flags.printLimit == 0)
+	{
+		flags.printLimit = -1;
+	}
+	flags.u.b.isString = true;
+	if ((conv.flags & FormatConversion::Json) != 0)
+	{
+		return s == nullptr || PutJson(s);
+	}
+	return PutString((s != nullptr) ? s : "<null>");
+}
+
+bool ConversionPrinter::PrintInteger(const FormatConversion& conv, long long val) noexcept
+{
+	FormattedPrinter fp(sink);
+	const bool ok = fp.PrintConversion(conv, val);
+	length += fp.GetLength();
+	return ok;
+}
+
+bool ConversionPrinter::PrintFloat(const FormatConversion& conv, double val) noexcept
+{
+	FormattedPrinter fp(sink);
+	const bool ok = fp.PrintConversion(conv, val);
+	length += fp.GetLength();
+	return ok;
+}
+
+bool ConversionPrinter::PrintString(const FormatConversion& conv, const char *_ecv_array null s) noexcept
+{
+	FormattedPrinter fp(sink);
+	const bool ok = fp.PrintConversion(conv, s);
+	length += fp.GetLength();
+	return ok;
+}
+
+/*-----------------------------------------------------------*/
+
+// Default fill function for sinks that don't provide a more efficient one
+size_t PrintSink::Fill(char c, size_t count) noexcept
+{
+	char fillBuffer[16];
+	memset(fillBuffer, c, (count < sizeof(fillBuffer)) ? count : sizeof(fillBuffer));
+	size_t done = 0;
+	while (done < count)
+	{
+		const size_t chunk = (count - done < sizeof(fillBuffer)) ? count - done : sizeof(fillBuffer);
+		const size_t written = Write(fillBuffer, chunk);
+		done += written;
+		if (written != chunk)
+		{
+			break;
+		}
+	}
+	return done;
+}
+
+size_t PutcFuncSink::Write(const char *_ecv_array s, size_t len) noexcept
+{
+	size_t written = 0;
+	while (written < len && putcFunc(s[written]))
+	{
+		++written;
+	}
+	return written;
+}
+
+size_t PutcFuncSink::Fill(char c, size_t count) noexcept
+{
+	size_t written = 0;
+	while (written < count && putcFunc(c))
+	{
+		++written;
+	}
+	return written;
+}
+
+size_t BufferSink::Write(const char *_ecv_array s, size_t len) noexcept
+{
+	// Always leave room for the null terminator
+	const size_t toCopy = (spaceLeft <= 1) ? 0 : (len < spaceLeft - 1) ? len : spaceLeft - 1;
+	memcpy(buffer, s, toCopy);
+	buffer += toCopy;
+	spaceLeft -= toCopy;
+	return toCopy;
+}
+
+size_t BufferSink::Fill(char c, size_t count) noexcept
+{
+	const size_t toFill = (spaceLeft <= 1) ? 0 : (count < spaceLeft - 1) ? count : spaceLeft - 1;
+	memset(buffer, c, toFill);
+	buffer += toFill;
+	spaceLeft -= toFill;
+	return toFill;
+}
+
+StringRefSink::StringRefSink(const StringRef& ref) noexcept : StringRefSink(ref, ref.strlen())
+{
+}
+
+StringRefSink::StringRefSink(const StringRef& ref, size_t currentLength) noexcept
+	: BufferSink(ref.Pointer() + currentLength, ref.Capacity() + 1 - currentLength)
+{
+}
+
+size_t StringRefSink::Write(const char *_ecv_array s, size_t len) noexcept
+{
+	const size_t written = BufferSink::Write(s, len);
+	Terminate();
+	return written;
+}
+
+size_t StringRefSink::Fill(char c, size_t count) noexcept
+{
+	const size_t written = BufferSink::Fill(c, count);
+	Terminate();
+	return written;
+}
+
+/*-----------------------------------------------------------*/
+
+// Sink that discards a number of characters and passes the rest on, used to skip the part of an item that was printed before the sink became full
+class SkipSink : public PrintSink
+{
+public:
+	SkipSink(PrintSink& t, size_t n) noexcept : target(t), toSkip(n) { }
+
+	size_t Write(const char *_ecv_array s, size_t len) noexcept override
+	{
+		if (len <= toSkip)
+		{
+			toSkip -= len;
+			return len;
+		}
+		const size_t skipped = toSkip;
+		toSkip = 0;
+		return skipped + target.Write(s + skipped, len - skipped);
+	}
+
+	size_t Fill(char c, size_t count) noexcept override
+	{
+		if (count <= toSkip)
+		{
+			toSkip -= count;
+			return count;
+		}
+		const size_t skipped = toSkip;
+		toSkip = 0;
+		return skipped + target.Fill(c, count - skipped);
+	}
+
+	void Finish() noexcept override { target.Finish(); }
+
+private:
+	PrintSink& target;
+	size_t toSkip;
+};
+
+bool ResumablePrinter::Continue(PrintSink& sink) noexcept
+{
+	if (format == nullptr)
+	{
+		return true;
+	}
+
+	// If the sink became full part way through an item then we print that item again, discarding the characters that we have already sent
+	SkipSink skipSink(sink, charsDone);
+	FormattedPrinter fp((charsDone == 0) ? sink : skipSink);
+	CapturedArgs argSource(args, numArgs, argIndex);
+	fp.Print(format, argSource);
+	length += fp.GetLength() - (int)charsDone;
+	if (fp.SinkBecameFull())
+	{
+		fp.GetResumePoint(format, argIndex, charsDone);
+		return false;
+	}
+	format = nullptr;
+	return true;
+}
+
+int PrintWithCapturedArgs(PrintSink& sink, const char *_ecv_array format, const CapturedPrintArg *_ecv_array args, size_t numArgs) noexcept
+{
+	CapturedArgs argSource(args, numArgs, 0);
+	FormattedPrinter fp(sink);
+	return fp.Print(format, argSource);
+}
+
+/*-----------------------------------------------------------*/
+
+int vuprintf(PrintSink& sink, const char *_ecv_array format, va_list args) noexcept
+{
+	VaListArgs argSource(args);
+	FormattedPrinter fp(sink);
+	return fp.Print(format, argSource);
+}
+
+int uprintf(PrintSink& sink, const char *_ecv_array format, ...) noexcept
+{
+	va_list vargs;
+	va_start(vargs, format);
+	const int ret = vuprintf(sink, format, vargs);
+	va_end(vargs);
+	return ret;
+}
+
 int vuprintf(PutcFunc_t putc_f, const char *_ecv_array format, va_list args) noexcept
 {
-	FormattedPrinter fp(putc_f);
-	return fp.Print(format, args);
+	PutcFuncSink sink(putc_f);
+	return vuprintf(sink, format, args);
 }
 
 int uprintf(PutcFunc_t putc_f, const char *_ecv_array format, ...) noexcept
 {
 	va_list vargs;
 	va_start(vargs, format);
-	FormattedPrinter fp(putc_f);
-	const int ret = fp.Print(format, vargs);
+	PutcFuncSink sink(putc_f);
+	const int ret = vuprintf(sink, format, vargs);
 	va_end(vargs);
 	return ret;
 }
 
 int SafeVsnprintf(char *_ecv_array buffer, size_t maxLen, const char *_ecv_array format, va_list args) noexcept
 {
-	// Declare the lambda function separately from declaring the FormattedPrinter so that it doesn't go out of scope before the FormattedPrinter does
-	auto lambda = [&buffer, &maxLen](char c) noexcept -> bool
-						{
-							if (c != 0 && maxLen > 1)
-							{
-								*buffer++ = c;
-								--maxLen;
-								return true;
-							}
-							return false;
-						};
-	FormattedPrinter fp(lambda);
-	const int ret = fp.Print(format, args);
-	*buffer = 0;
+	BufferSink sink(buffer, maxLen);
+	const int ret = vuprintf(sink, format, args);
+	sink.Terminate();
 	return ret;
 }
 
@@ -799,4 +1290,21 @@ int SafeSnprintf(char *_ecv_array buffer, size_t buf_size, const char *_ecv_arra
 	return ret;
 }
 
+int MeasureVsnprintf(const char *_ecv_array format, va_list args) noexcept
+{
+	MeasureSink sink;
+	VaListArgs argSource(args);
+	FormattedPrinter fp(sink, true);
+	return fp.Print(format, argSource);
+}
+
+int MeasureSnprintf(const char *_ecv_array format, ...) noexcept
+{
+	va_list vargs;
+	va_start(vargs, format);
+	const int ret = MeasureVsnprintf(format, vargs);
+	va_end(vargs);
+	return ret;
+}
+
 // End
@@ -11,10 +11,82 @@
 #include "../ecv_duet3d.h"
 #include <cstdarg>
 #include <cstddef>
+#include <cstdint>
+#include <type_traits>
 #include "function_ref.h"
 
 typedef function_ref_noexcept<bool(char) noexcept> PutcFunc_t;
 
+// Interface to something that receives formatted output a block at a time
+class PrintSink
+{
+public:
+	virtual ~PrintSink() noexcept { }
+
+	// Send or store 'len' characters, returning the number accepted. If this is less than 'len' then the sink is full and printing stops.
+	virtual size_t Write(const char *_ecv_array s, size_t len) noexcept = 0;
+
+	// Send or store 'count' copies of 'c', returning the number accepted. Used for padding.
+	virtual size_t Fill(char c, size_t count) noexcept;
+
+	// Called when printing has completed, e.g. to store a terminator
+	virtual void Finish() noexcept { }
+};
+
+// Sink that sends each character to a PutcFunc_t, to support the per-character interface
+class PutcFuncSink : public PrintSink
+{
+public:
+	explicit PutcFuncSink(const PutcFunc_t& pcf) noexcept : putcFunc(pcf) { }
+
+	size_t Write(const char *_ecv_array s, size_t len) noexcept override;
+	size_t Fill(char c, size_t count) noexcept override;
+	void Finish() noexcept override { (void)putcFunc(0); }
+
+private:
+	PutcFunc_t putcFunc;
+};
+
+// Sink that stores characters in a buffer, leaving room for a null terminator
+class BufferSink : public PrintSink
+{
+public:
+	BufferSink(char *_ecv_array buf, size_t maxLen) noexcept : buffer(buf), spaceLeft(maxLen) { }
+
+	size_t Write(const char *_ecv_array s, size_t len) noexcept override;
+	size_t Fill(char c, size_t count) noexcept override;
+
+	// Store a null terminator
+	void Terminate() noexcept { *buffer = 0; }
+
+private:
+	char *_ecv_array buffer;
+	size_t spaceLeft;
+};
+
+// Sink that stores nothing and accepts everything, used to find how many characters some output needs, e.g. JsonWriter output
+class MeasureSink : public PrintSink
+{
+public:
+	size_t Write(const char *_ecv_array, size_t len) noexcept override { return len; }
+	size_t Fill(char, size_t count) noexcept override { return count; }
+};
+
+class StringRef;
+
+// Sink that appends to the string in a StringRef, keeping it null-terminated
+class StringRefSink : public BufferSink
+{
+public:
+	explicit StringRefSink(const StringRef& ref) noexcept;
+
+	size_t Write(const char *_ecv_array s, size_t len) noexcept override;
+	size_t Fill(char c, size_t count) noexcept override;
+
+private:
+	StringRefSink(const StringRef& ref, size_t currentLength) noexcept;
+};
+
 // These functions are like vprintf and printf but each character to print is sent through a function
 // The putc function must behave as follows:
 // If the character passed is not zero: if possible, send or store the character and return true; else store a terminator if necessary and return false to terminate the vuprintf call.
@@ -23,9 +95,134 @@ typedef function_ref_noexcept<bool(char) noexcept> PutcFunc_t;
 int vuprintf(PutcFunc_t putc_f, const char *_ecv_array format, va_list args) noexcept;
 int uprintf(PutcFunc_t putc_f, const char *_ecv_array format, ...) noexcept __attribute__ ((format (printf, 2, 3)));
 
+// These functions send the output to a sink in blocks, which is more efficient than calling a function for each character.
+// The sink's Finish function is called when printing is complete. If the sink became full then it may or may not be called.
+int vuprintf(PrintSink& sink, const char *_ecv_array format, va_list args) noexcept;
+int uprintf(PrintSink& sink, const char *_ecv_array format, ...) noexcept __attribute__ ((format (printf, 2, 3)));
+
+// Description of one conversion in a format string, e.g. "%-8.3f", for printing formats that have already been parsed
+struct FormatConversion
+{
+	static constexpr uint8_t Hash = 0x01;
+	static constexpr uint8_t PadRight = 0x02;
+	static constexpr uint8_t PadZero = 0x04;
+	static constexpr uint8_t ForceSign = 0x08;
+	static constexpr uint8_t SignOrSpace = 0x10;
+	static constexpr uint8_t Json = 0x20;			// the specifier was exactly "%.s"
+	static constexpr uint8_t Long64 = 0x40;			// the specifier had the "ll" modifier
+
+	char letter;									// the conversion letter, or 0 if there is no conversion
+	uint8_t flags;
+	int16_t width;
+	int16_t precision;								// -1 if no precision was given
+};
+
+// Class to print conversions that have already been parsed, using the same code as vuprintf. Each function returns false if the sink became full.
+class ConversionPrinter
+{
+public:
+	explicit ConversionPrinter(PrintSink& s) noexcept : sink(s), length(0) { }
+
+	bool PrintLiteral(const char *_ecv_array s, size_t len) noexcept
+	{
+		const size_t written = (len == 0) ? 0 : sink.Write(s, len);
+		length += (int)written;
+		return written == len;
+	}
+
+	bool PrintInteger(const FormatConversion& conv, long long val) noexcept;				// for conversions d, i, u, x, X, o, p and c
+	bool PrintFloat(const FormatConversion& conv, double val) noexcept;					// for conversions f, e, g, F, E and G
+	bool PrintString(const FormatConversion& conv, const char *_ecv_array null s) noexcept;	// for conversion s
+
+	// Tell the sink that printing is complete and return the number of characters printed
+	int Finish() noexcept { sink.Finish(); return length; }
+
+	int GetLength() const noexcept { return length; }
+
+private:
+	PrintSink& sink;
+	int length;
+};
+
+// Value of an argument saved by ResumablePrinter. As with printf, the format determines which member is used.
+union CapturedPrintArg
+{
+	long long i;									// integers, characters and pointers other than strings
+	double f;
+	const char *_ecv_array null s;
+};
+
+// Class to print a format and its arguments to a sink that may become full before printing is complete, e.g. when sending a long response in fixed-size packets.
+// When the sink becomes full, the position in the format, the index of the next argument and the number of characters of the current item already printed are saved.
+// The next call to Continue carries on from there, so only the item that was interrupted is formatted again, instead of the whole format.
+// The constructor copies the arguments, but not the strings that they point to, so those must remain valid until printing is complete.
+// The arguments must match the format in the same way as for printf, but types smaller than long long don't need the "ll" modifier.
+// Example: ResumablePrinter printer("%s is %.1fC\n", name, temperature); while (!printer.Continue(packetSink)) { SendPacket(packetSink); }
+class ResumablePrinter
+{
+public:
+	static constexpr size_t MaxArgs = 16;
+
+	template<class... Args> explicit ResumablePrinter(const char *_ecv_array fmt, const Args&... a) noexcept
+		: format(fmt), argIndex(0), charsDone(0), numArgs(sizeof...(Args)), length(0), args{ Capture(a)... }
+	{
+		static_assert(sizeof...(Args) <= MaxArgs, "Too many arguments for ResumablePrinter");
+	}
+
+	// Print as much as possible. Return true if printing is complete, or false if the sink became full and Continue must be called again to print the rest.
+	bool Continue(PrintSink& sink) noexcept;
+
+	bool IsComplete() const noexcept { return format == nullptr; }
+	int GetLength() const noexcept { return length; }					// the number of characters printed so far
+
+private:
+	template<class T> static CapturedPrintArg Capture(const T& val) noexcept;
+
+	const char *_ecv_array null format;				// the start of the next item to print, or null if printing is complete
+	size_t argIndex;								// the index of the first argument used by that item
+	size_t charsDone;								// the number of characters of that item that have already been printed
+	size_t numArgs;
+	int length;
+	CapturedPrintArg args[MaxArgs];
+};
+
+template<class T> CapturedPrintArg ResumablePrinter::Capture(const T& val) noexcept
+{
+	typedef typename std::decay<T>::type U;
+	CapturedPrintArg arg;
+	arg.i = 0;
+	if constexpr (std::is_floating_point<U>::value)
+	{
+		arg.f = (double)val;
+	}
+	else if constexpr (std::is_same<U, const char *>::value || std::is_same<U, char *>::value)
+	{
+		arg.s = val;
+	}
+	else if constexpr (std::is_pointer<U>::value)
+	{
+		arg.i = (long long)(uintptr_t)val;
+	}
+	else if constexpr (!std::is_same<U, std::nullptr_t>::value)
+	{
+		static_assert(std::is_integral<U>::value || std::is_enum<U>::value, "Unsupported argument type for ResumablePrinter");
+		arg.i = (long long)val;
+	}
+	return arg;
+}
+
+// Print a format using arguments that were saved earlier, e.g. by DeferredLog, in the same way as uprintf
+int PrintWithCapturedArgs(PrintSink& sink, const char *_ecv_array format, const CapturedPrintArg *_ecv_array args, size_t numArgs) noexcept;
+
 int SafeVsnprintf(char *_ecv_array buffer, size_t maxLen, const char *_ecv_array format, va_list args) noexcept;
 int SafeSnprintf(char *_ecv_array buffer, size_t maxLen, const char *_ecv_array format, ...) noexcept __attribute__ ((format (printf, 3, 4)));
 
+// Return the number of characters that SafeSnprintf would print with unlimited buffer space, excluding the null terminator, without storing anything.
+// So a buffer of at least 1 more than this length is big enough. To size the result of StringRef::catf, add the current length of the string.
+// String arguments are only measured, not copied, so this is much faster than printing to a large buffer.
+int MeasureVsnprintf(const char *_ecv_array format, va_list args) noexcept;
+int MeasureSnprintf(const char *_ecv_array format, ...) noexcept __attribute__ ((format (printf, 1, 2)));
+
 extern "C" [[deprecated("use SafeSnprintf instead of snprintf")]] int snprintf(char * s, size_t n, const char * format, ...);
 extern "C" [[deprecated("use SafeVsnprintf instead of vsnprintf")]] int vsnprintf(char * s, size_t n, const char * format, va_list arg);
 
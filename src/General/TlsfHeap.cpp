@@ -0,0 +1,461 @@
+/*
+ * TlsfHeap.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ */
+
+#include "TlsfHeap.h"
+#include "StringRef.h"
+
+// Return the number of the highest set bit, which must exist
+static inline unsigned int HighestSetBit(size_t val) noexcept
+{
+	return (unsigned int)(sizeof(unsigned long) * 8 - 1) - (unsigned int)__builtin_clzl((unsigned long)val);
+}
+
+// Return the number of the lowest set bit, which must exist
+static inline unsigned int LowestSetBit32(uint32_t val) noexcept
+{
+	return (unsigned int)__builtin_ctzl((unsigned long)val);
+}
+
+TlsfHeap::TlsfHeap() noexcept
+	: firstBlock(nullptr), flBitmap(0), usedBytes(0), peakUsedBytes(0)
+#ifdef RTOS
+	  , mutex(nullptr), useCriticalSection(false)
+#endif
+{
+	nullBlock.prevPhysical = nullptr;
+	nullBlock.size = 0;
+	nullBlock.nextFree = &nullBlock;
+	nullBlock.prevFree = &nullBlock;
+	for (unsigned int fl = 0; fl < FlIndexCount; ++fl)
+	{
+		slBitmaps[fl] = 0;
+		for (unsigned int sl = 0; sl < SlIndexCount; ++sl)
+		{
+			blocks[fl][sl] = &nullBlock;
+		}
+	}
+}
+
+// Give the heap a region of memory to manage, returning false if it is too small or too large
+bool TlsfHeap::Init(void *_ecv_array mem, size_t bytes) noexcept
+{
+	// The first block's size field must be within the region, but its prevPhysical field is never used so it may be outside.
+	// The last block is a zero-length sentinel, whose size field must be within the region.
+	const uintptr_t memStart = (uintptr_t)mem;
+	const uintptr_t dataStart = (memStart + BlockOverhead + (Alignment - 1)) & ~(uintptr_t)(Alignment - 1);
+	const uintptr_t memEnd = memStart + bytes;
+	if (firstBlock != nullptr || memEnd < dataStart + BlockSpacing + BlockSizeMin)
+	{
+		return false;
+	}
+	const size_t size = (size_t)(memEnd - dataStart - BlockSpacing) & ~(Alignment - 1);
+	if (size < BlockSizeMin || size >= BlockSizeMax)						// a block of BlockSizeMax would map to a list beyond the last one
+	{
+		return false;
+	}
+
+	BlockHeader *const b = FromPointer(reinterpret_cast<void *>(dataStart));
+	b->size = size;
+	b->SetFree();
+	b->SetPrevUsed();
+	InsertFreeBlock(b);
+	firstBlock = b;
+
+	BlockHeader *const sentinel = LinkNext(b);
+	sentinel->size = 0;
+	sentinel->SetUsed();
+	sentinel->SetPrevFree();
+	return true;
+}
+
+// Convert a size to the indices of the list that would hold it
+void TlsfHeap::MappingInsert(size_t size, unsigned int& fl, unsigned int& sl) noexcept
+{
+	if (size < SmallBlockSize)
+	{
+		// Store small blocks in the first list
+		fl = 0;
+		sl = (unsigned int)size/(SmallBlockSize/SlIndexCount);
+	}
+	else
+	{
+		const unsigned int hsb = HighestSetBit(size);
+		sl = (unsigned int)(size >> (hsb - SlIndexCountLog2)) ^ (1u << SlIndexCountLog2);
+		fl = hsb - (FlIndexShift - 1);
+	}
+}
+
+// Convert a size to the indices of the first list whose blocks are all at least that size
+void TlsfHeap::MappingSearch(size_t size, unsigned int& fl, unsigned int& sl) noexcept
+{
+	if (size >= SmallBlockSize)
+	{
+		size += ((size_t)1 << (HighestSetBit(size) - SlIndexCountLog2)) - 1;
+	}
+	MappingInsert(size, fl, sl);
+}
+
+// Return the largest request that MappingSearch maps to a list that a free block of this size could be in
+size_t TlsfHeap::RoundDownToSizeClass(size_t size) noexcept
+{
+	return (size < SmallBlockSize) ? size : size & ~(((size_t)1 << (HighestSetBit(size) - SlIndexCountLog2)) - 1);
+}
+
+// Find a non-empty list at or after the one given, updating the indices
+TlsfHeap::BlockHeader *_ecv_null TlsfHeap::SearchSuitableBlock(unsigned int& fl, unsigned int& sl) const noexcept
+{
+	uint32_t slMap = slBitmaps[fl] & (~(uint32_t)0 << sl);
+	if (slMap == 0)
+	{
+		// No block exists in this first-level list, so search the larger ones
+		const uint32_t flMap = flBitmap & (~(uint32_t)0 << (fl + 1));
+		if (flMap == 0)
+		{
+			return nullptr;
+		}
+		fl = LowestSetBit32(flMap);
+		slMap = slBitmaps[fl];
+	}
+	sl = LowestSetBit32(slMap);
+	return blocks[fl][sl];
+}
+
+void TlsfHeap::RemoveFreeBlock(BlockHeader *b, unsigned int fl, unsigned int sl) noexcept
+{
+	BlockHeader *const prev = not_null(b->prevFree);
+	BlockHeader *const next = not_null(b->nextFree);
+	next->prevFree = prev;
+	prev->nextFree = next;
+
+	if (blocks[fl][sl] == b)
+	{
+		blocks[fl][sl] = next;
+		if (next == &nullBlock)
+		{
+			slBitmaps[fl] &= ~((uint32_t)1 << sl);
+			if (slBitmaps[fl] == 0)
+			{
+				flBitmap &= ~((uint32_t)1 << fl);
+			}
+		}
+	}
+}
+
+void TlsfHeap::InsertFreeBlock(BlockHeader *b, unsigned int fl, unsigned int sl) noexcept
+{
+	BlockHeader *const current = blocks[fl][sl];
+	b->nextFree = current;
+	b->prevFree = &nullBlock;
+	current->prevFree = b;
+	blocks[fl][sl] = b;
+	flBitmap |= (uint32_t)1 << fl;
+	slBitmaps[fl] |= (uint32_t)1 << sl;
+}
+
+void TlsfHeap::RemoveFreeBlock(BlockHeader *b) noexcept
+{
+	unsigned int fl, sl;
+	MappingInsert(b->GetSize(), fl, sl);
+	RemoveFreeBlock(b, fl, sl);
+}
+
+void TlsfHeap::InsertFreeBlock(BlockHeader *b) noexcept
+{
+	unsigned int fl, sl;
+	MappingInsert(b->GetSize(), fl, sl);
+	InsertFreeBlock(b, fl, sl);
+}
+
+// Set the prevPhysical field of the next block to point to this one and return the next block
+TlsfHeap::BlockHeader *TlsfHeap::LinkNext(BlockHeader *b) noexcept
+{
+	BlockHeader *const next = GetNext(b);
+	next->prevPhysical = b;
+	return next;
+}
+
+void TlsfHeap::MarkAsFree(BlockHeader *b) noexcept
+{
+	BlockHeader *const next = LinkNext(b);
+	next->SetPrevFree();
+	b->SetFree();
+}
+
+void TlsfHeap::MarkAsUsed(BlockHeader *b) noexcept
+{
+	BlockHeader *const next = GetNext(b);
+	next->SetPrevUsed();
+	b->SetUsed();
+}
+
+// Split a block into one with the given data size and the remainder, returning the remainder
+TlsfHeap::BlockHeader *TlsfHeap::Split(BlockHeader *b, size_t size) noexcept
+{
+	BlockHeader *const remaining = OffsetToBlock(ToPointer(b), size - BlockOverhead);
+	const size_t remainingSize = b->GetSize() - (size + BlockSpacing);
+	remaining->size = remainingSize;
+	b->SetSize(size);
+	MarkAsFree(remaining);
+	return remaining;
+}
+
+// Merge a block into the physically previous one, which must be free, returning the merged block
+TlsfHeap::BlockHeader *TlsfHeap::Absorb(BlockHeader *prev, BlockHeader *b) noexcept
+{
+	prev->size += b->GetSize() + BlockSpacing;
+	(void)LinkNext(prev);
+	return prev;
+}
+
+// Merge a block that is being freed with the previous block if that is free
+TlsfHeap::BlockHeader *TlsfHeap::MergePrev(BlockHeader *b) noexcept
+{
+	if (b->IsPrevFree())
+	{
+		BlockHeader *const prev = not_null(b->prevPhysical);
+		RemoveFreeBlock(prev);
+		b = Absorb(prev, b);
+	}
+	return b;
+}
+
+// Merge a block that is being freed with the next block if that is free
+TlsfHeap::BlockHeader *TlsfHeap::MergeNext(BlockHeader *b) noexcept
+{
+	BlockHeader *const next = GetNext(b);
+	if (next->IsFree())
+	{
+		RemoveFreeBlock(next);
+		b = Absorb(b, next);
+	}
+	return b;
+}
+
+// Return the unwanted end of a block that we are about to allocate to the free lists
+void TlsfHeap::TrimFree(BlockHeader *b, size_t size) noexcept
+{
+	if (CanSplit(b, size))
+	{
+		BlockHeader *const remaining = Split(b, size);
+		(void)LinkNext(b);
+		remaining->SetPrevFree();
+		InsertFreeBlock(remaining);
+	}
+}
+
+// Find a free block of at least the given size and remove it from the free lists
+TlsfHeap::BlockHeader *_ecv_null TlsfHeap::LocateFree(size_t size) noexcept
+{
+	unsigned int fl, sl;
+	MappingSearch(size, fl, sl);
+	if (fl < FlIndexCount)
+	{
+		BlockHeader *const b = SearchSuitableBlock(fl, sl);
+		if (b != nullptr)
+		{
+			RemoveFreeBlock(b, fl, sl);
+			return b;
+		}
+	}
+	return nullptr;
+}
+
+// Allocate memory, returning nullptr if there is no free block large enough
+void *_ecv_null TlsfHeap::Allocate(size_t size) noexcept
+{
+	if (size == 0 || size > AllocationSizeMax)
+	{
+		return nullptr;
+	}
+	size = (size + (Alignment - 1)) & ~(Alignment - 1);
+	if (size < BlockSizeMin)
+	{
+		size = BlockSizeMin;
+	}
+
+#ifdef RTOS
+	MutexLocker lock(mutex);
+	ConditionalTaskCriticalSectionLocker csLock(useCriticalSection);
+#endif
+	BlockHeader *const b = LocateFree(size);
+	if (b == nullptr)
+	{
+		return nullptr;
+	}
+	TrimFree(b, size);
+	MarkAsUsed(b);
+	usedBytes += b->GetSize();
+	if (usedBytes > peakUsedBytes)
+	{
+		peakUsedBytes = usedBytes;
+	}
+	return ToPointer(b);
+}
+
+// Free memory previously returned by Allocate
+void TlsfHeap::Free(void *_ecv_null p) noexcept
+{
+	if (p != nullptr)
+	{
+#ifdef RTOS
+		MutexLocker lock(mutex);
+		ConditionalTaskCriticalSectionLocker csLock(useCriticalSection);
+#endif
+		BlockHeader *b = FromPointer(not_null(p));
+		usedBytes -= b->GetSize();
+		MarkAsFree(b);
+		b = MergePrev(b);
+		b = MergeNext(b);
+		InsertFreeBlock(b);
+	}
+}
+
+// Return the usable size of an allocated block
+size_t TlsfHeap::GetAllocatedSize(const void *p) noexcept
+{
+	return FromPointer(p)->GetSize();
+}
+
+// Return the largest size that Allocate would currently succeed for
+size_t TlsfHeap::GetLargestFreeBlock() const noexcept
+{
+#ifdef RTOS
+	MutexLocker lock(mutex);
+	ConditionalTaskCriticalSectionLocker csLock(useCriticalSection);
+#endif
+	if (flBitmap == 0)
+	{
+		return 0;
+	}
+
+	// The largest block is in the highest non-empty list, but the blocks in that list may differ in size
+	const unsigned int fl = HighestSetBit(flBitmap);
+	const unsigned int sl = HighestSetBit(slBitmaps[fl]);
+	size_t largest = 0;
+	for (const BlockHeader *b = blocks[fl][sl]; b != &nullBlock; b = not_null(b->nextFree))
+	{
+		if (b->GetSize() > largest)
+		{
+			largest = b->GetSize();
+		}
+	}
+	return RoundDownToSizeClass(largest);
+}
+
+// Walk all the blocks to collect statistics
+void TlsfHeap::GetStats(Stats& stats) const noexcept
+{
+	stats.totalFreeBytes = stats.largestFreeBlock = stats.largestAllocation = stats.numFreeBlocks = stats.numUsedBlocks = 0;
+
+#ifdef RTOS
+	MutexLocker lock(mutex);
+	ConditionalTaskCriticalSectionLocker csLock(useCriticalSection);
+#endif
+	if (firstBlock != nullptr)
+	{
+		for (const BlockHeader *b = not_null(firstBlock); !b->IsLast(); b = GetNext(b))
+		{
+			if (b->IsFree())
+			{
+				++stats.numFreeBlocks;
+				stats.totalFreeBytes += b->GetSize();
+				if (b->GetSize() > stats.largestFreeBlock)
+				{
+					stats.largestFreeBlock = b->GetSize();
+				}
+			}
+			else
+			{
+				++stats.numUsedBlocks;
+			}
+		}
+	}
+	stats.largestAllocation = RoundDownToSizeClass(stats.largestFreeBlock);
+}
+
+// Append a report of the statistics to 'reply'
+void TlsfHeap::AppendReport(const StringRef& reply) const noexcept
+{
+	Stats stats;
+	GetStats(stats);
+	reply.lcatf("Heap used %u peak %u, free %u in %u blocks, largest block %u allocatable %u, fragmentation %u%%",
+					(unsigned int)usedBytes, (unsigned int)peakUsedBytes, (unsigned int)stats.totalFreeBytes, (unsigned int)stats.numFreeBlocks,
+					(unsigned int)stats.largestFreeBlock, (unsigned int)stats.largestAllocation, stats.GetFragmentationPercent());
+}
+
+// Walk all the blocks checking that the heap is consistent, returning true if it is
+bool TlsfHeap::Check() const noexcept
+{
+#ifdef RTOS
+	MutexLocker lock(mutex);
+	ConditionalTaskCriticalSectionLocker csLock(useCriticalSection);
+#endif
+	if (firstBlock == nullptr)
+	{
+		return true;
+	}
+
+	// Check the physical blocks
+	size_t numFree = 0;
+	bool prevFree = false;
+	const BlockHeader *prev = nullptr;
+	for (const BlockHeader *b = not_null(firstBlock); ; b = GetNext(b))
+	{
+		if (b->IsPrevFree() != prevFree || (prevFree && b->prevPhysical != prev))
+		{
+			return false;
+		}
+		if (b->IsLast())
+		{
+			break;
+		}
+		if (b->GetSize() < BlockSizeMin || ((uintptr_t)ToPointer(b) & (Alignment - 1)) != 0)
+		{
+			return false;
+		}
+		if (b->IsFree())
+		{
+			if (prevFree)
+			{
+				return false;						// adjacent free blocks should have been merged
+			}
+			++numFree;
+		}
+		prevFree = b->IsFree();
+		prev = b;
+	}
+
+	// Check the free lists and bitmaps
+	size_t numInLists = 0;
+	for (unsigned int fl = 0; fl < FlIndexCount; ++fl)
+	{
+		if (((flBitmap >> fl) & 1u) != (slBitmaps[fl] != 0))
+		{
+			return false;
+		}
+		for (unsigned int sl = 0; sl < SlIndexCount; ++sl)
+		{
+			if (((slBitmaps[fl] >> sl) & 1u) != (blocks[fl][sl] != &nullBlock))
+			{
+				return false;
+			}
+			for (const BlockHeader *b = blocks[fl][sl]; b != &nullBlock; b = not_null(b->nextFree))
+			{
+				unsigned int flb, slb;
+				MappingInsert(b->GetSize(), flb, slb);
+				if (!b->IsFree() || flb != fl || slb != sl)
+				{
+					return false;
+				}
+				++numInLists;
+			}
+		}
+	}
+	return numInLists == numFree;
+}
+
+// End
@@ -0,0 +1,176 @@
+/*
+ * TlsfHeap.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ *
+ *  Two-level segregated fit memory allocator, after the design by Masmano, Ripoll, Crespo and Real and the public domain implementation by Matthew Conte.
+ */
+
+#ifndef SRC_GENERAL_TLSFHEAP_H_
+#define SRC_GENERAL_TLSFHEAP_H_
+
+#include "../ecv_duet3d.h"
+#include <cstdint>
+#include <cstddef>
+#ifdef RTOS
+# include "../RTOSIface/RTOSIface.h"
+#endif
+
+class StringRef;
+
+// Allocator that manages a region of memory supplied by the caller. Allocate and Free take a bounded time that doesn't depend on the number of blocks,
+// because free blocks are kept in lists segregated by size and bitmaps record which lists are non-empty, so a suitable block is found with two find-first-set operations.
+// A block that is too large is split, and a freed block is merged with its free neighbours immediately, which keeps fragmentation low.
+// Each allocated block has an overhead of 8 bytes, and returned memory is aligned to 8 bytes.
+// By default there is no locking. Under an RTOS, call SetMutex or SetUseCriticalSection if more than one task uses the heap. It must never be used from an ISR.
+class TlsfHeap
+{
+public:
+	struct Stats
+	{
+		size_t totalFreeBytes;
+		size_t largestFreeBlock;				// the size of the largest free block
+		size_t largestAllocation;				// the largest size that Allocate can return, which may be less because requests are rounded up to the next size class
+		size_t numFreeBlocks;
+		size_t numUsedBlocks;
+
+		// Return the percentage of free memory that is not in the largest free block
+		unsigned int GetFragmentationPercent() const noexcept
+		{
+			return (totalFreeBytes == 0) ? 0 : (unsigned int)(100 - (uint64_t)largestFreeBlock * 100/totalFreeBytes);
+		}
+	};
+
+	TlsfHeap() noexcept;
+
+	// Give the heap a region of memory to manage, returning false if it is too small or too large. Call this once before allocating.
+	bool Init(void *_ecv_array mem, size_t bytes) noexcept;
+
+	// Allocate memory, returning nullptr if there is no free block large enough
+	void *_ecv_null Allocate(size_t size) noexcept;
+
+	// Free memory previously returned by Allocate. Does nothing if p is null.
+	void Free(void *_ecv_null p) noexcept;
+
+	// Return the usable size of an allocated block, which may be larger than was asked for
+	static size_t GetAllocatedSize(const void *p) noexcept;
+
+	// Return the largest size that Allocate would currently succeed for. This takes time proportional to the number of free blocks of similar size.
+	// It may be up to 1/16 less than the largest free block, because Allocate rounds requests up to the next size class so that any block in the list it searches is big enough.
+	size_t GetLargestFreeBlock() const noexcept;
+
+	// Return the number of bytes allocated, including rounding up but not block overheads, and the maximum that has been allocated
+	size_t GetUsedBytes() const noexcept { return usedBytes; }
+	size_t GetPeakUsedBytes() const noexcept { return peakUsedBytes; }
+
+	// Walk all the blocks to collect statistics. This takes time proportional to the number of blocks.
+	void GetStats(Stats& stats) const noexcept;
+
+	// Append a report of the statistics to 'reply'
+	void AppendReport(const StringRef& reply) const noexcept;
+
+	// Walk all the blocks checking that the heap is consistent, returning true if it is
+	bool Check() const noexcept;
+
+#ifdef RTOS
+	// Use a mutex to protect the heap, or pass nullptr to stop doing so
+	void SetMutex(Mutex *_ecv_null m) noexcept { mutex = m; }
+
+	// Suspend task scheduling while allocating and freeing, which is faster than using a mutex
+	void SetUseCriticalSection(bool b) noexcept { useCriticalSection = b; }
+#endif
+
+	static constexpr size_t Alignment = 8;
+
+	TlsfHeap(const TlsfHeap&) = delete;
+	TlsfHeap& operator=(const TlsfHeap&) = delete;
+
+private:
+	// The prevPhysical field is only valid if the previous block is free, and it overlaps the end of the previous block, so the overhead of a used block is just the size field.
+	// It is padded to 8 bytes so that blocks are 8-byte aligned on 32-bit processors too; there the overhead is 8 bytes, of which 4 are unused.
+	struct BlockHeader
+	{
+		union
+		{
+			BlockHeader *_ecv_null prevPhysical;
+			uint8_t padding[8];
+		};
+		size_t size;								// the size of the block excluding the overhead, with the flags in the low bits
+		BlockHeader *_ecv_null nextFree;
+		BlockHeader *_ecv_null prevFree;
+
+		static constexpr size_t FreeBit = 1;
+		static constexpr size_t PrevFreeBit = 2;
+
+		size_t GetSize() const noexcept { return size & ~(FreeBit | PrevFreeBit); }
+		void SetSize(size_t s) noexcept { size = s | (size & (FreeBit | PrevFreeBit)); }
+		bool IsFree() const noexcept { return (size & FreeBit) != 0; }
+		void SetFree() noexcept { size |= FreeBit; }
+		void SetUsed() noexcept { size &= ~FreeBit; }
+		bool IsPrevFree() const noexcept { return (size & PrevFreeBit) != 0; }
+		void SetPrevFree() noexcept { size |= PrevFreeBit; }
+		void SetPrevUsed() noexcept { size &= ~PrevFreeBit; }
+		bool IsLast() const noexcept { return GetSize() == 0; }
+	};
+
+	static constexpr unsigned int AlignmentLog2 = 3;
+	static constexpr unsigned int SlIndexCountLog2 = 4;
+	static constexpr unsigned int SlIndexCount = 1u << SlIndexCountLog2;
+	static constexpr unsigned int FlIndexMax = 30;
+	static constexpr unsigned int FlIndexShift = SlIndexCountLog2 + AlignmentLog2;
+	static constexpr unsigned int FlIndexCount = FlIndexMax - FlIndexShift + 1;
+	static constexpr size_t SmallBlockSize = (size_t)1 << FlIndexShift;
+
+	static constexpr size_t BlockOverhead = sizeof(size_t);										// the part of the header that precedes the data
+	static constexpr size_t BlockStartOffset = offsetof(BlockHeader, size) + sizeof(size_t);	// offset of the data from the start of the header
+	static constexpr size_t BlockSpacing = BlockStartOffset - BlockOverhead;					// distance from the end of one block's data to the start of the next one's
+
+	// A free block must have room for the free list pointers, and the start of the header of the next block overlaps its end
+	static constexpr size_t BlockSizeMin = (offsetof(BlockHeader, prevFree) + sizeof(BlockHeader *) - BlockStartOffset + BlockOverhead + Alignment - 1) & ~(Alignment - 1);
+	static constexpr size_t BlockSizeMax = (size_t)1 << FlIndexMax;										// blocks must be smaller than this
+	static constexpr size_t AllocationSizeMax = BlockSizeMax - (BlockSizeMax >> (SlIndexCountLog2 + 1));	// larger requests would be rounded up to BlockSizeMax
+
+	static_assert((1u << AlignmentLog2) == Alignment);
+	static_assert(BlockSpacing % Alignment == 0, "Blocks would not be aligned");
+
+	static void *ToPointer(const BlockHeader *b) noexcept { return reinterpret_cast<uint8_t *>(const_cast<BlockHeader *>(b)) + BlockStartOffset; }
+	static BlockHeader *FromPointer(const void *p) noexcept { return reinterpret_cast<BlockHeader *>(const_cast<uint8_t *>(static_cast<const uint8_t *>(p)) - BlockStartOffset); }
+	static BlockHeader *OffsetToBlock(const void *p, size_t offset) noexcept { return reinterpret_cast<BlockHeader *>(const_cast<uint8_t *>(static_cast<const uint8_t *>(p)) + offset); }
+	static BlockHeader *GetNext(const BlockHeader *b) noexcept { return OffsetToBlock(ToPointer(b), b->GetSize() - BlockOverhead); }
+
+	static BlockHeader *LinkNext(BlockHeader *b) noexcept;
+	static void MarkAsFree(BlockHeader *b) noexcept;
+	static void MarkAsUsed(BlockHeader *b) noexcept;
+	static bool CanSplit(const BlockHeader *b, size_t size) noexcept { return b->GetSize() >= size + BlockSpacing + BlockSizeMin; }
+	static BlockHeader *Split(BlockHeader *b, size_t size) noexcept;
+	static BlockHeader *Absorb(BlockHeader *prev, BlockHeader *b) noexcept;
+
+	static void MappingInsert(size_t size, unsigned int& fl, unsigned int& sl) noexcept;
+	static void MappingSearch(size_t size, unsigned int& fl, unsigned int& sl) noexcept;
+	static size_t RoundDownToSizeClass(size_t size) noexcept;
+
+	BlockHeader *_ecv_null SearchSuitableBlock(unsigned int& fl, unsigned int& sl) const noexcept;
+	void RemoveFreeBlock(BlockHeader *b, unsigned int fl, unsigned int sl) noexcept;
+	void InsertFreeBlock(BlockHeader *b, unsigned int fl, unsigned int sl) noexcept;
+	void RemoveFreeBlock(BlockHeader *b) noexcept;
+	void InsertFreeBlock(BlockHeader *b) noexcept;
+	BlockHeader *MergePrev(BlockHeader *b) noexcept;
+	BlockHeader *MergeNext(BlockHeader *b) noexcept;
+	void TrimFree(BlockHeader *b, size_t size) noexcept;
+	BlockHeader *_ecv_null LocateFree(size_t size) noexcept;
+
+	BlockHeader nullBlock;									// the free lists end with this instead of nullptr, which saves some tests
+	BlockHeader *_ecv_null firstBlock;
+	uint32_t flBitmap;										// which first-level lists have non-empty second-level lists
+	uint32_t slBitmaps[FlIndexCount];						// which second-level lists are non-empty
+	BlockHeader *blocks[FlIndexCount][SlIndexCount];		// the heads of the free lists
+	size_t usedBytes;
+	size_t peakUsedBytes;
+#ifdef RTOS
+	Mutex *_ecv_null mutex;
+	bool useCriticalSection;
+#endif
+};
+
+#endif /* SRC_GENERAL_TLSFHEAP_H_ */
@@ -178,7 +178,17 @@ void TaskBase::TerminateAndUnlink() noexcept
 	if (taskId != 0)
 	{
 		taskId = 0;
+#ifdef FREELIST_TASK_CACHE
+		// Return the items in the task's free list cache to the shared lists. If the task is deleting itself then vTaskDelete won't return, so do this first.
+		if (this == GetCallerTaskHandle())
+		{
+			FreelistManager::TaskCache::Flush(freelistCache);
+		}
+#endif
 		vTaskDelete(GetFreeRTOSHandle());
+#ifdef FREELIST_TASK_CACHE
+		FreelistManager::TaskCache::Flush(freelistCache);
+#endif
 
 		// Unlink the task from the thread list
 		TaskCriticalSectionLocker lock;
@@ -163,6 +163,10 @@ private:
 
 #ifdef RTOS
 
+#ifdef FREELIST_TASK_CACHE
+namespace FreelistManager { class TaskCache; }
+#endif
+
 // Our TaskBase structure now extends the FreeRTOS one
 class TaskBase : public StaticTask_t
 {
@@ -172,7 +176,11 @@ public:
 	// This is used by the CAN subsystem, so that we can use 8-bit task IDs to identify a sending task, instead of needing to use 32-bits.
 	typedef uint32_t TaskId;
 
-	TaskBase() noexcept : next(nullptr), taskId(0) { }
+	TaskBase() noexcept : next(nullptr), taskId(0)
+#ifdef FREELIST_TASK_CACHE
+						, freelistCache(nullptr)
+#endif
+	{ }
 	~TaskBase() noexcept { TerminateAndUnlink(); }
 
 	// Get the short-form task ID. This is a small number, used to send a task ID in 1 byte or less i a CAN packet. It is guaranteed not to be zero.
@@ -248,9 +256,17 @@ public:
 
 	static constexpr uint32_t TimeoutUnlimited = 0xFFFFFFFFu;
 
+#ifdef FREELIST_TASK_CACHE
+	// Get the pointer to this task's cache of free list items. Only FreelistManager should use this.
+	FreelistManager::TaskCache *_ecv_null& GetFreelistCache() noexcept { return freelistCache; }
+#endif
+
 protected:
 	TaskBase *_ecv_from _ecv_null next;
 	TaskId taskId;
+#ifdef FREELIST_TASK_CACHE
+	FreelistManager::TaskCache *_ecv_null freelistCache;
+#endif
 
 	static TaskBase *_ecv_from _ecv_null taskList;
 	static TaskId numTasks;
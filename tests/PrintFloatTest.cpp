@@ -0,0 +1,121 @@
+/*
+ * PrintFloatTest.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: David
+ *
+ *  Host test of the floating point conversions of SafeSnprintf. Build and run it from the root of the repository with e.g.
+ *    g++ -std=gnu++17 -O2 -I src -I src/General tests/PrintFloatTest.cpp -o PrintFloatTest && ./PrintFloatTest
+ *  It returns a nonzero exit code if any check fails.
+ */
+
+// SafeVsnprintf.h declares snprintf and vsnprintf deprecated, which conflicts with the host C library's declarations, so rename ours
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#define snprintf DeprecatedSnprintf
+#define vsnprintf DeprecatedVsnprintf
+#include "SafeVsnprintf.h"
+#undef snprintf
+#undef vsnprintf
+
+// Compile the library sources into this file so that the renaming applies to them too
+#include "SafeVsnprintf.cpp"
+#include "FloatToDecimal.cpp"
+#include "IntegerToDecimal.cpp"
+#include "StringRef.cpp"
+#include "Strnlen.cpp"
+
+static unsigned int numChecks = 0, numFailures = 0;
+
+static void Check(bool ok, const char *what, const char *format, double d, const char *got, const char *expected) noexcept
+{
+	++numChecks;
+	if (!ok && ++numFailures <= 20)
+	{
+		printf("%s: format \"%s\" value %.17g gave \"%s\" expected \"%s\"\n", what, format, d, got, expected);
+	}
+}
+
+// The C library prints at least 2 exponent digits but we print as few as possible, so remove leading zeros from the exponent
+static void NormaliseExponent(char *s) noexcept
+{
+	char *e = strpbrk(s, "eE");
+	if (e != nullptr && (e[1] == '+' || e[1] == '-'))
+	{
+		char *digits = e + 2;
+		char *p = digits;
+		while (*p == '0' && p[1] >= '0' && p[1] <= '9')
+		{
+			++p;
+		}
+		memmove(digits, p, strlen(p) + 1);
+	}
+}
+
+// Compare %f and %e output with the C library, which rounds correctly
+static void CheckAgainstLibrary(float f) noexcept
+{
+	static const char *const formats[] = { "%.0f", "%.1f", "%.2f", "%.3f", "%.6f", "%.9f", "%#.0f", "%10.2f", "%.0e", "%.3e", "%.6e", "%.8e", "%+.3e" };
+	for (const char *format : formats)
+	{
+		// Our fixed point format prints fewer decimal digits when the scaled value doesn't fit in a long long, and switches to exponent format above 2^63
+		if (strchr(format, 'f') != nullptr && fabs((double)f) * pow(10.0, atoi(strchr(format, '.') + 1)) >= 9.0e17)
+		{
+			continue;
+		}
+		char got[400], expected[400];
+		SafeSnprintf(got, sizeof(got), format, (double)f);
+		snprintf(expected, sizeof(expected), format, (double)f);
+		NormaliseExponent(expected);
+		Check(strcmp(got, expected) == 0, "library mismatch", format, (double)f, got, expected);
+	}
+}
+
+// %g with a high precision chooses fixed point format for large numbers, which we can't print, so it must give the same as %e
+static void CheckLargeG(double d) noexcept
+{
+	static const char *const pairs[][2] = { { "%.19g", "%.19e" }, { "%.20g", "%.20e" }, { "%.25G", "%.25E" } };
+	for (const auto& pair : pairs)
+	{
+		char got[400], expected[400];
+		SafeSnprintf(got, sizeof(got), pair[0], d);
+		SafeSnprintf(expected, sizeof(expected), pair[1], d);
+		Check(strcmp(got, expected) == 0, "large %g", pair[0], d, got, expected);
+	}
+}
+
+int main()
+{
+	// Floats spread over the whole range, including denormals, plus some that are exactly representable in decimal
+	for (uint64_t bits = 0; bits < 0x7F800000u; bits += 99991u)
+	{
+		float f;
+		const uint32_t b = (uint32_t)bits;
+		memcpy(&f, &b, sizeof(f));
+		CheckAgainstLibrary(f);
+		if (b != 0)
+		{
+			CheckAgainstLibrary(-f);								// we don't print a sign for negative zero
+		}
+		if (f > 9.2233720e18f)
+		{
+			CheckLargeG((double)f);
+			CheckLargeG(-(double)f);
+		}
+	}
+	for (float f : { 0.5f, 2.5f, 0.125f, 1.0e6f, 7654664.5f, 3.4028235e38f, 1.0e-45f })
+	{
+		CheckAgainstLibrary(f);
+	}
+
+	// Float and double values above 2^63, which used to return an uninitialised value with %g
+	for (double d : { (double)1.0e20f, 18446744073709551616.0, (double)3.4028235e38f, 1.0e20, 1.0e300 })
+	{
+		CheckLargeG(d);
+	}
+
+	printf("%u checks, %u failures\n", numChecks, numFailures);
+	return (numFailures == 0) ? 0 : 1;
+}